@@ -0,0 +1,159 @@
+#ifndef BAR_ENGINE_H
+#define BAR_ENGINE_H
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "state_image.h"
+#include "symbol_directory.h"
+#include "trade_types.h"
+
+/* One symbol's bar for one interval */
+struct BarRow {
+    uint16_t stock_locate;
+    SymbolDirectory::Symbol symbol;
+    uint32_t open; // prices in 1/10000 ticks
+    uint32_t high;
+    uint32_t low;
+    uint32_t close;
+    uint32_t trades;
+    uint64_t volume;
+    Notional notional; // VWAP is worked out by the writer
+};
+
+/*
+    OHLCV + VWAP bars of a fixed interval for every locate.
+    State is one flat array indexed by locate, plus a bitmap of the locates that traded in the current bar,
+        so a trade is a handful of stores and closing a bar only visits the locates that traded in it.
+    Bars are closed when the clock moves into a later interval, intervals without trades produce nothing.
+    Broken trades don't revise bars, the bar they belong to may already be written out.
+*/
+class BarEngine {
+public:
+    explicit BarEngine(const uint64_t interval_ns = 0)
+    : interval_ns_{interval_ns} {
+        if (enabled()) {
+            next_bar_start_ = interval_ns_;
+            bars_.resize(kMaxLocates);
+            touched_.resize(kMaxLocates / 64);
+        }
+    }
+
+    bool enabled() const {
+        return interval_ns_ != 0;
+    }
+
+    uint64_t interval_ns() const {
+        return interval_ns_;
+    }
+
+    /* Start of the bar that is being built */
+    uint64_t bar_start() const {
+        return bar_start_;
+    }
+
+    /* True if timestamp falls in a later bar than the current one, which then needs closing. No division, it's per message */
+    bool crosses_bar(const uint64_t timestamp) const {
+        return timestamp >= next_bar_start_;
+    }
+
+    void add_trade(const Trade& trade) {
+        if (!enabled()) {
+            return;
+        }
+        Bar& bar = bars_[trade.stock_locate];
+        uint64_t& word = touched_[trade.stock_locate / 64];
+        const uint64_t bit = uint64_t(1) << (trade.stock_locate % 64);
+        if (!(word & bit)) {
+            word |= bit;
+            max_touched_word_ = std::max<size_t>(max_touched_word_, trade.stock_locate / 64 + 1);
+            bar = Bar{trade.price, trade.price, trade.price, trade.price, 0, 0, 0};
+        }
+        bar.high = std::max(bar.high, trade.price);
+        bar.low = std::min(bar.low, trade.price);
+        bar.close = trade.price;
+        bar.trades++;
+        bar.volume += trade.shares;
+        bar.notional += Notional(trade.price) * trade.shares;
+    }
+
+    /*
+        Moves the current bar into rows (in locate order, only locates with a symbol)
+            and starts the bar that timestamp falls in.
+    */
+    void close_bar(const uint64_t timestamp, const SymbolDirectory& symbols, std::vector<BarRow>& rows) {
+        for (size_t w = 0; w < max_touched_word_; ++w) {
+            uint64_t word = touched_[w];
+            while (word) {
+                const size_t locate = w * 64 + __builtin_ctzll(word);
+                word &= word - 1;
+                if (!symbols.contains(locate)) {
+                    continue;
+                }
+                const Bar& bar = bars_[locate];
+                BarRow& row = rows.emplace_back();
+                row.stock_locate = static_cast<uint16_t>(locate);
+                std::copy_n(symbols.get(locate), kSymbolLength, row.symbol.begin());
+                row.open = bar.open;
+                row.high = bar.high;
+                row.low = bar.low;
+                row.close = bar.close;
+                row.trades = bar.trades;
+                row.volume = bar.volume;
+                row.notional = bar.notional;
+            }
+            touched_[w] = 0;
+        }
+        max_touched_word_ = 0;
+        bar_start_ = timestamp - timestamp % interval_ns_;
+        next_bar_start_ = bar_start_ + interval_ns_;
+    }
+
+    /* The bar being built: its start, and the bars of the locates that traded in it so far */
+    void save(StateWriter& out) const {
+        out.put(bar_start_);
+        out.put(next_bar_start_);
+        out.put(max_touched_word_);
+        out.put_array(touched_.data(), max_touched_word_);
+        for (size_t w = 0; w < max_touched_word_; ++w) {
+            for (uint64_t word = touched_[w]; word; word &= word - 1) {
+                out.put(bars_[w * 64 + __builtin_ctzll(word)]);
+            }
+        }
+    }
+
+    /* Into an engine of the same interval that hasn't seen a trade yet */
+    bool load(StateReader& in) {
+        if (!in.get(bar_start_) || !in.get(next_bar_start_) || !in.get(max_touched_word_)
+            || max_touched_word_ > touched_.size() || !in.get_array(touched_.data(), max_touched_word_)) {
+            return false;
+        }
+        for (size_t w = 0; w < max_touched_word_; ++w) {
+            for (uint64_t word = touched_[w]; word; word &= word - 1) {
+                if (!in.get(bars_[w * 64 + __builtin_ctzll(word)])) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    struct Bar {
+        uint32_t open;
+        uint32_t high;
+        uint32_t low;
+        uint32_t close;
+        uint32_t trades;
+        uint64_t volume;
+        Notional notional;
+    };
+
+    uint64_t interval_ns_;
+    uint64_t bar_start_ = 0;
+    uint64_t next_bar_start_ = ~uint64_t(0); // never crossed when disabled
+    std::vector<Bar> bars_; // key = stock locate
+    std::vector<uint64_t> touched_; // bit per locate that traded in the current bar
+    size_t max_touched_word_ = 0; // touched_ words past this are all 0
+};
+
+#endif // BAR_ENGINE_H
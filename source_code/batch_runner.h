@@ -0,0 +1,209 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "day_runner.h"
+#include "options.h"
+
+/*
+    Batch mode (--batch): many days, each run by run_day into <output dir>/<day>/,
+        where <day> is the data file name without .gz.
+    Days are a directory (every file in it) or a list file (one path per line, # comments).
+    Up to --jobs days run at the same time, each with its own threads, and a day only starts
+        once its estimated memory (estimate_day_memory) fits in what's left of --memory-budget,
+        so a machine full of big days doesn't swap. A day bigger than the whole budget runs on its own.
+    Biggest days go first, smaller ones fill in around them.
+*/
+class BatchRunner {
+public:
+    explicit BatchRunner(const Options& options): options_{options} {}
+
+    /* Returns false if the days couldn't be listed or any of them failed */
+    bool run() {
+        if (!list_days_()) {
+            return false;
+        }
+        if (days_.empty()) {
+            std::cerr << "No data files in " << options_.batch_path << std::endl;
+            return false;
+        }
+
+        const size_t threads_per_day = options_.workers + options_.decoders;
+        size_t jobs = options_.jobs;
+        if (jobs == 0) {
+            jobs = std::max<size_t>(1, std::thread::hardware_concurrency() / threads_per_day);
+        }
+        jobs = std::min(jobs, days_.size());
+        budget_ = options_.memory_budget != 0 ? options_.memory_budget : available_memory_();
+
+        std::cout << days_.size() << " days, up to " << jobs << " at a time";
+        if (budget_ != 0) {
+            std::cout << " within " << budget_ / (1024 * 1024) << " MB";
+        }
+        std::cout << std::endl;
+
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> pool;
+        for (size_t i = 0; i < jobs; ++i) {
+            pool.emplace_back(&BatchRunner::work_, this);
+        }
+        for (auto& thread: pool) {
+            thread.join();
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << days_.size() - failed_ << " days done";
+        if (failed_ != 0) {
+            std::cout << ", " << failed_ << " failed";
+        }
+        std::cout << " in " << std::fixed << std::setprecision(1) << seconds << " s" << std::endl;
+        return failed_ == 0;
+    }
+
+private:
+    struct Day {
+        std::string data_file_path;
+        std::string name;
+        uint64_t memory;
+        bool started = false;
+    };
+
+    const Options& options_;
+    std::vector<Day> days_;
+    uint64_t budget_ = 0; // 0 = no limit
+
+    std::mutex mutex_;
+    std::condition_variable day_finished_;
+    uint64_t memory_in_use_ = 0;
+    size_t running_ = 0;
+    size_t finished_ = 0;
+    size_t failed_ = 0;
+
+    void work_() {
+        while (Day* day = next_day_()) {
+            Options options = options_;
+            options.data_file_path = day->data_file_path;
+            options.output_dir_path = (std::filesystem::path(options_.output_dir_path) / day->name).string();
+            if (!options.stats_path.empty()) {
+                options.stats_path = (std::filesystem::path(options.output_dir_path) / options_.stats_path).string();
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            const bool ok = run_day(options, false);
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            memory_in_use_ -= day->memory;
+            --running_;
+            ++finished_;
+            failed_ += !ok;
+            std::cout << "[" << finished_ << "/" << days_.size() << "] " << day->name << ": "
+            << std::fixed << std::setprecision(1) << seconds << " s" << (ok ? "" : ", FAILED") << std::endl;
+            day_finished_.notify_all();
+        }
+    }
+
+    /* Blocks until a day fits in the budget, nullptr once every day has started */
+    Day* next_day_() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            Day* candidate = nullptr;
+            bool pending = false;
+            for (Day& day: days_) {
+                if (day.started) {
+                    continue;
+                }
+                pending = true;
+                if (budget_ == 0 || running_ == 0 || memory_in_use_ + day.memory <= budget_) {
+                    candidate = &day;
+                    break;
+                }
+            }
+            if (!pending) {
+                return nullptr;
+            }
+            if (candidate != nullptr) {
+                candidate->started = true;
+                memory_in_use_ += candidate->memory;
+                ++running_;
+                return candidate;
+            }
+            day_finished_.wait(lock);
+        }
+    }
+
+    bool list_days_() {
+        namespace fs = std::filesystem;
+        std::vector<std::string> paths;
+        std::error_code error;
+        if (fs::is_directory(options_.batch_path, error)) {
+            for (const fs::directory_entry& entry: fs::directory_iterator(options_.batch_path, error)) {
+                if (entry.is_regular_file() && entry.path().filename().string()[0] != '.') {
+                    paths.push_back(entry.path().string());
+                }
+            }
+            if (error) {
+                std::cerr << "Error listing " << options_.batch_path << std::endl;
+                return false;
+            }
+            std::sort(paths.begin(), paths.end());
+        } else {
+            std::ifstream ifs(options_.batch_path);
+            if (!ifs.is_open()) {
+                std::cerr << "Error opening day list " << options_.batch_path << std::endl;
+                return false;
+            }
+            std::string line;
+            while (std::getline(ifs, line)) {
+                const size_t first = line.find_first_not_of(" \t\r");
+                if (first == std::string::npos || line[first] == '#') {
+                    continue;
+                }
+                const size_t last = line.find_last_not_of(" \t\r");
+                paths.push_back(line.substr(first, last - first + 1));
+            }
+        }
+
+        std::set<std::string> names;
+        for (const std::string& path: paths) {
+            std::string name = fs::path(path).filename().string();
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0) {
+                name.resize(name.size() - 3);
+            }
+            if (!names.insert(name).second) {
+                std::cerr << "Two days would both be written to " << name << "/: " << path << std::endl;
+                return false;
+            }
+            days_.push_back(Day{path, name, estimate_day_memory(options_, path)});
+        }
+        std::stable_sort(days_.begin(), days_.end(), [](const Day& a, const Day& b) { return a.memory > b.memory; });
+        return true;
+    }
+
+    /* MemAvailable from /proc/meminfo, 0 if unknown */
+    static uint64_t available_memory_() {
+        std::ifstream meminfo("/proc/meminfo");
+        std::string line;
+        while (std::getline(meminfo, line)) {
+            unsigned long long kb = 0;
+            if (std::sscanf(line.c_str(), "MemAvailable: %llu kB", &kb) == 1) {
+                return kb * 1024;
+            }
+        }
+        return 0;
+    }
+};
+
+#endif // BATCH_RUNNER_H
@@ -0,0 +1,606 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "../itch_generator.h"
+#include "../message_types.h"
+#include "../metrics.h"
+#include "../security_stats.h"
+#include "../shared_stats.h"
+#include "../snapshot_format.h"
+#include "../snapshot_writer.h"
+#include "../symbol_directory.h"
+#include "../system_data.h"
+
+/*
+    Microbenchmarks of the hot paths, each on its own, on synthetic data built in memory.
+    The data comes from a fixed seed, so every run measures the same thing.
+    Every benchmark runs --repeats times (setup not timed) and reports its fastest run,
+        in ns per operation and operations per second (an operation is one message, order, trade, row...).
+
+    Usage: benchmarks [<name filter>] [--repeats=<n>]
+*/
+
+namespace {
+
+size_t g_repeats = 5;
+std::string g_filter;
+
+/* Keeps the compiler from optimizing away a result nobody reads */
+template <typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/* Runs setup then body (which does ops operations) g_repeats times, and prints the fastest body */
+template <typename Setup, typename Body>
+void benchmark(const std::string& name, const char* unit, const uint64_t ops, Setup&& setup, Body&& body) {
+    if (!g_filter.empty() && name.find(g_filter) == std::string::npos) {
+        return;
+    }
+    double best_ns = 1e300;
+    for (size_t i = 0; i < g_repeats; ++i) {
+        setup();
+        const auto start = std::chrono::steady_clock::now();
+        body();
+        const auto stop = std::chrono::steady_clock::now();
+        best_ns = std::min(best_ns, std::chrono::duration<double, std::nano>(stop - start).count());
+    }
+    std::printf("%-44s %10.2f ns/op %10.2f M%s/s\n", name.c_str(), best_ns / ops, ops * 1e3 / best_ns, unit);
+    std::fflush(stdout);
+}
+
+template <typename Body>
+void benchmark(const std::string& name, const char* unit, const uint64_t ops, Body&& body) {
+    benchmark(name, unit, ops, [] {}, body);
+}
+
+/*
+    Messages of a given type, or a mix of them, with plausible contents:
+        executions, replaces and deletes only refer to orders that are still live.
+    Unlike ItchGenerator there is no timeline, it's just what's needed to feed the decoders.
+*/
+class MessageGenerator {
+public:
+    static constexpr uint16_t kNumLocates = 8000;
+
+    explicit MessageGenerator(const uint64_t seed = 42): rng_{seed} {}
+
+    void system_event(std::string& out, const char event_code) {
+        ItchEncoder(out).system_event(next_timestamp_(), event_code);
+    }
+
+    void stock_directory(std::string& out, const uint16_t locate) {
+        ItchEncoder(out).stock_directory(next_timestamp_(), locate, symbol_of(locate).data());
+    }
+
+    /* 'A' or 'F' */
+    void add_order(std::string& out, const char type = 'A') {
+        const uint16_t locate = random_locate_();
+        const uint64_t reference = next_reference_++;
+        ItchEncoder(out).add_order(next_timestamp_(), locate, reference, (rng_() & 1) ? 'B' : 'S',
+            100 * (1 + rng_() % 10), symbol_of(locate).data(), random_price_(), type == 'F');
+        live_orders_.push_back(reference);
+    }
+
+    /* 'E' or 'C' */
+    void order_executed(std::string& out, const char type = 'E') {
+        ItchEncoder encoder(out);
+        if (type == 'E') {
+            encoder.order_executed(next_timestamp_(), random_locate_(), live_order_(), 100, next_match_++);
+        } else {
+            encoder.order_executed_with_price(next_timestamp_(), random_locate_(), live_order_(), 100, next_match_++,
+                true, random_price_());
+        }
+    }
+
+    void order_replace(std::string& out) {
+        uint64_t& live = live_orders_[rng_() % live_orders_.size()];
+        const uint64_t original = live;
+        live = next_reference_++;
+        ItchEncoder(out).order_replace(next_timestamp_(), random_locate_(), original, live,
+            100 * (1 + rng_() % 10), random_price_());
+    }
+
+    /* Order Delete, only decoded for the order book: framed and skipped otherwise */
+    void order_delete(std::string& out) {
+        const size_t i = rng_() % live_orders_.size();
+        ItchEncoder(out).order_delete(next_timestamp_(), random_locate_(), live_orders_[i]);
+        live_orders_[i] = live_orders_.back();
+        live_orders_.pop_back();
+    }
+
+    void trade(std::string& out) {
+        const uint16_t locate = random_locate_();
+        ItchEncoder(out).trade(next_timestamp_(), locate, 100 * (1 + rng_() % 10), symbol_of(locate).data(),
+            random_price_(), next_match_++);
+    }
+
+    void cross_trade(std::string& out) {
+        const uint16_t locate = random_locate_();
+        ItchEncoder(out).cross_trade(next_timestamp_(), locate, 1000 * (1 + rng_() % 10), symbol_of(locate).data(),
+            random_price_(), next_match_++, 'O');
+    }
+
+    void broken_trade(std::string& out) {
+        ItchEncoder(out).broken_trade(next_timestamp_(), random_locate_(), 1 + rng_() % next_match_);
+    }
+
+    /* One message of the given type */
+    void message(std::string& out, const char type) {
+        switch (type) {
+            case 'S': system_event(out, 'Q'); break;
+            case 'R': stock_directory(out, random_locate_()); break;
+            case 'A': case 'F': add_order(out, type); break;
+            case 'E': case 'C': order_executed(out, type); break;
+            case 'U': order_replace(out); break;
+            case 'D': order_delete(out); break;
+            case 'P': trade(out); break;
+            case 'Q': cross_trade(out); break;
+            case 'B': broken_trade(out); break;
+        }
+    }
+
+    /* Roughly the mix of a real day: mostly adds and deletes, a few percent of executions */
+    void mixed(std::string& out, const size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            const uint32_t dice = rng_() % 1000;
+            if (live_orders_.size() < 1000 || dice < 400) {
+                add_order(out, dice % 50 == 0 ? 'F' : 'A');
+            } else if (dice < 750) {
+                order_delete(out);
+            } else if (dice < 880) {
+                order_replace(out);
+            } else if (dice < 950) {
+                order_executed(out, dice % 10 == 0 ? 'C' : 'E');
+            } else if (dice < 995) {
+                trade(out);
+            } else if (dice < 999) {
+                cross_trade(out);
+            } else {
+                broken_trade(out);
+            }
+        }
+    }
+
+    /* Stock Directory messages for every locate, then the market opens */
+    void start_of_day(std::string& out) {
+        for (uint16_t locate = 1; locate <= kNumLocates; ++locate) {
+            stock_directory(out, locate);
+        }
+        system_event(out, 'Q');
+    }
+
+    static SymbolDirectory::Symbol symbol_of(const uint16_t locate) {
+        return ItchGenerator::symbol_of(locate - 1);
+    }
+
+private:
+    std::mt19937_64 rng_;
+    uint64_t timestamp_ = uint64_t(34200) * 1'000'000'000; // 9:30, stays within the hour
+    uint64_t next_reference_ = 1;
+    uint64_t next_match_ = 1;
+    std::vector<uint64_t> live_orders_;
+
+    uint64_t next_timestamp_() {
+        timestamp_ += rng_() % 1000;
+        return timestamp_;
+    }
+
+    uint16_t random_locate_() {
+        return static_cast<uint16_t>(1 + rng_() % kNumLocates);
+    }
+
+    uint32_t random_price_() {
+        return static_cast<uint32_t>(10'0000 + rng_() % 500'0000);
+    }
+
+    uint64_t live_order_() {
+        if (live_orders_.empty()) {
+            return 0;
+        }
+        return live_orders_[rng_() % live_orders_.size()];
+    }
+};
+
+/* Frames and decodes every message of data into a ring of slots, the way MessageReader does */
+template <uint32_t Fields>
+size_t decode_all(const std::string& data, std::vector<Message>& slots) {
+    const MessageDecoderTable& decoders = kMessageDecoders<Fields>;
+    const size_t mask = slots.size() - 1;
+    const char* pos = data.data();
+    const char* const end = pos + data.size();
+    size_t decoded = 0;
+    while (pos < end) {
+        const uint16_t msg_len = read_big_endian<2>(pos);
+        if (decoders[static_cast<uint8_t>(pos[2])](pos + 3, slots[decoded & mask])) {
+            ++decoded;
+        }
+        pos += 2 + msg_len;
+    }
+    keep(slots[0]);
+    return decoded;
+}
+
+/* Decodes data into one Message per message, skipped types left out */
+template <uint32_t Fields = kVwapFields>
+std::vector<Message> decode_to_vector(const std::string& data) {
+    std::vector<Message> messages;
+    const char* pos = data.data();
+    const char* const end = pos + data.size();
+    while (pos < end) {
+        const uint16_t msg_len = read_big_endian<2>(pos);
+        Message& slot = messages.emplace_back();
+        if (!kMessageDecoders<Fields>[static_cast<uint8_t>(pos[2])](pos + 3, slot)) {
+            messages.pop_back();
+        }
+        pos += 2 + msg_len;
+    }
+    return messages;
+}
+
+template <size_t Width>
+void benchmark_read_big_endian(const std::vector<char>& bytes) {
+    const size_t count = (bytes.size() - 8) / Width;
+    constexpr size_t kPasses = 8;
+    benchmark("read_big_endian<" + std::to_string(Width) + ">", "reads", kPasses * count, [&] {
+        uint64_t sum = 0;
+        for (size_t pass = 0; pass < kPasses; ++pass) {
+            for (size_t i = 0; i < count; ++i) {
+                sum += read_big_endian<Width>(bytes.data() + i * Width);
+            }
+            keep(sum); // every pass reads the bytes again
+        }
+    });
+}
+
+void decode_benchmarks() {
+    std::mt19937_64 rng(7);
+    std::vector<char> bytes(size_t(1) << 20);
+    for (char& byte: bytes) {
+        byte = static_cast<char>(rng());
+    }
+    benchmark_read_big_endian<2>(bytes);
+    benchmark_read_big_endian<4>(bytes);
+    benchmark_read_big_endian<6>(bytes);
+    benchmark_read_big_endian<8>(bytes);
+
+    constexpr size_t kMessages = size_t(1) << 16;
+    std::vector<Message> slots(4096);
+    for (const char type: {'S', 'R', 'A', 'F', 'E', 'C', 'U', 'P', 'Q', 'B', 'D'}) {
+        MessageGenerator generator;
+        std::string data;
+        // Live orders for the executions, replaces and deletes to refer to
+        for (size_t i = 0; i < kMessages + 1000; ++i) {
+            generator.add_order(data);
+        }
+        data.clear();
+        for (size_t i = 0; i < kMessages; ++i) {
+            generator.message(data, type);
+        }
+        benchmark(std::string("decode/") + type, "msgs", kMessages, [&] {
+            keep(decode_all<kVwapFields>(data, slots));
+        });
+        if (type == 'A' || type == 'P') {
+            benchmark(std::string("decode/") + type + " (all fields)", "msgs", kMessages, [&] {
+                keep(decode_all<kAllFields>(data, slots));
+            });
+        }
+    }
+
+    MessageGenerator generator;
+    std::string mixed;
+    generator.mixed(mixed, kMessages * 4);
+    benchmark("decode/mixed (framing + dispatch)", "msgs", kMessages * 4, [&] {
+        keep(decode_all<kVwapFields>(mixed, slots));
+    });
+}
+
+void dispatch_benchmarks(SnapshotWriter& writer) {
+    MessageGenerator generator;
+    std::string start;
+    generator.start_of_day(start);
+    std::string day;
+    generator.mixed(day, size_t(1) << 20);
+    std::vector<Message> start_messages = decode_to_vector(start);
+    std::vector<Message> messages = decode_to_vector(day);
+
+    benchmark("dispatch/visit get_timestamp", "msgs", messages.size(), [&] {
+        uint64_t sum = 0;
+        for (const Message& msg: messages) {
+            sum += get_timestamp(msg);
+        }
+        keep(sum);
+    });
+
+    std::unique_ptr<SystemData> sd;
+    benchmark("dispatch/process_message (mixed day)", "msgs", messages.size(), [&] {
+        sd = std::make_unique<SystemData>(writer, size_t(1) << 20);
+        for (Message& msg: start_messages) {
+            process_message(msg, *sd);
+        }
+    }, [&] {
+        for (Message& msg: messages) {
+            process_message(msg, *sd);
+        }
+    });
+
+    // Same day with --book-depth=5: deletes are processed too, every order update also moves a price level
+    std::vector<Message> book_messages = decode_to_vector<kBookFields>(day);
+    benchmark("dispatch/process_message (mixed day, book)", "msgs", book_messages.size(), [&] {
+        sd = std::make_unique<SystemData>(writer, size_t(1) << 20, false, 0, 5);
+        for (Message& msg: start_messages) {
+            process_message(msg, *sd);
+        }
+    }, [&] {
+        for (Message& msg: book_messages) {
+            process_message(msg, *sd);
+        }
+    });
+
+    // What the parser's stats cost on top: every n-th message timed into its type's histogram
+    for (const uint64_t sample: {uint64_t(256), uint64_t(1)}) {
+        std::unique_ptr<std::array<LatencyHistogram, std::variant_size_v<Message>>> latency;
+        benchmark("dispatch/process_message, 1/" + std::to_string(sample) + " timed", "msgs", messages.size(), [&] {
+            sd = std::make_unique<SystemData>(writer, size_t(1) << 20);
+            latency = std::make_unique<std::array<LatencyHistogram, std::variant_size_v<Message>>>();
+            for (Message& msg: start_messages) {
+                process_message(msg, *sd);
+            }
+        }, [&] {
+            uint64_t until_sample = sample;
+            for (Message& msg: messages) {
+                const bool timed = --until_sample == 0;
+                const uint64_t start = timed ? CycleClock::now() : 0;
+                process_message(msg, *sd);
+                if (timed) {
+                    (*latency)[msg.index()].record(CycleClock::now() - start);
+                    until_sample = sample;
+                }
+            }
+        });
+    }
+}
+
+void system_data_benchmarks(SnapshotWriter& writer) {
+    constexpr size_t kOrders = size_t(1) << 20;
+    std::mt19937_64 rng(11);
+    std::vector<Order> orders(kOrders);
+    uint64_t reference = 1;
+    for (Order& order: orders) {
+        reference += 1 + rng() % 4;
+        order = Order{static_cast<uint16_t>(1 + rng() % 8000), kBuy, 100, static_cast<uint32_t>(10'0000 + rng() % 500'0000), reference};
+    }
+    std::vector<uint64_t> shuffled(kOrders);
+    for (size_t i = 0; i < kOrders; ++i) {
+        shuffled[i] = orders[i].order_reference_number;
+    }
+    std::shuffle(shuffled.begin(), shuffled.end(), rng);
+
+    std::unique_ptr<SystemData> sd;
+    const auto fresh = [&] {
+        sd.reset();
+        sd = std::make_unique<SystemData>(writer, kOrders);
+    };
+    const auto fresh_with_orders = [&] {
+        fresh();
+        for (const Order& order: orders) {
+            sd->add_order(order);
+        }
+    };
+
+    benchmark("system_data/add_order", "orders", kOrders, fresh, [&] {
+        for (const Order& order: orders) {
+            sd->add_order(order);
+        }
+    });
+    fresh_with_orders();
+    benchmark("system_data/get_order_by_reference_number", "orders", kOrders, [&] {
+        Order order{};
+        uint64_t sum = 0;
+        for (const uint64_t reference_number: shuffled) {
+            sd->get_order_by_reference_number(reference_number, order);
+            sum += order.price;
+        }
+        keep(sum);
+    });
+    benchmark("system_data/replace_order", "orders", kOrders, fresh_with_orders, [&] {
+        for (const Order& order: orders) {
+            sd->replace_order(order.order_reference_number, order.order_reference_number + reference, 200, order.price + 1);
+        }
+    });
+
+    constexpr size_t kTrades = size_t(1) << 20;
+    std::vector<Trade> trades(kTrades);
+    for (size_t i = 0; i < kTrades; ++i) {
+        trades[i] = Trade{static_cast<uint16_t>(1 + rng() % 8000), 100, static_cast<uint32_t>(10'0000 + rng() % 500'0000), i + 1};
+    }
+    std::vector<uint64_t> broken(kTrades / 2);
+    for (uint64_t& match_number: broken) {
+        match_number = 1 + rng() % kTrades;
+    }
+    benchmark("system_data/add_trade", "trades", kTrades, fresh, [&] {
+        for (const Trade& trade: trades) {
+            sd->add_trade(trade);
+        }
+    });
+    benchmark("system_data/cancel_trade", "trades", broken.size(), [&] {
+        fresh();
+        for (const Trade& trade: trades) {
+            sd->add_trade(trade);
+        }
+    }, [&] {
+        for (const uint64_t match_number: broken) {
+            sd->cancel_trade(match_number);
+        }
+    });
+    sd.reset();
+}
+
+/*
+    Publishing the stats to shared memory (--shm), and what readers reading every slot over and over,
+        as fast as they can or every 100 us, cost the parser at the same time. The readers map the segment
+        on their own, as another process would. With fewer cores than threads they also take turns on the core
+        with the parser, which then costs far more than the cache lines they share.
+*/
+void shared_stats_benchmarks(SnapshotWriter& writer) {
+    const std::string name = "/itch_benchmarks_" + std::to_string(getpid());
+    SharedStats shared;
+    SharedStatsReader reader;
+    if (!shared.open(name) || !reader.open(name)) {
+        return;
+    }
+
+    MessageGenerator generator;
+    std::string start;
+    generator.start_of_day(start);
+    std::string day;
+    generator.mixed(day, size_t(1) << 20);
+    std::vector<Message> start_messages = decode_to_vector(start);
+    std::vector<Message> messages = decode_to_vector(day);
+
+    std::unique_ptr<SystemData> sd;
+    const auto fresh = [&] {
+        sd = std::make_unique<SystemData>(writer, size_t(1) << 20);
+        sd->enable_shared_stats(shared);
+        for (Message& msg: start_messages) {
+            process_message(msg, *sd);
+        }
+    };
+    struct Readers {
+        const char* name;
+        size_t count;
+        std::chrono::microseconds pause;
+    };
+    for (const Readers& config: {Readers{"no readers", 0, {}}, Readers{"1 reader spinning", 1, {}},
+        Readers{"2 readers spinning", 2, {}}, Readers{"1 reader every 100 us", 1, std::chrono::microseconds(100)}}) {
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> readers;
+        for (size_t i = 0; i < config.count; ++i) {
+            readers.emplace_back([&] {
+                SharedStatsRow row{};
+                while (!stop.load(std::memory_order_relaxed)) {
+                    for (uint16_t locate = 1; locate <= MessageGenerator::kNumLocates; ++locate) {
+                        reader.read(locate, row);
+                        keep(row.volume);
+                    }
+                    if (config.pause.count() != 0) {
+                        std::this_thread::sleep_for(config.pause);
+                    }
+                }
+            });
+        }
+        benchmark(std::string("shared_stats/process_message, ") + config.name, "msgs", messages.size(), fresh, [&] {
+            for (Message& msg: messages) {
+                process_message(msg, *sd);
+            }
+        });
+        stop = true;
+        for (std::thread& thread: readers) {
+            thread.join();
+        }
+    }
+
+    constexpr size_t kRounds = 64;
+    benchmark("shared_stats/read", "reads", kRounds * MessageGenerator::kNumLocates, [&] {
+        SharedStatsRow row{};
+        for (size_t round = 0; round < kRounds; ++round) {
+            for (uint16_t locate = 1; locate <= MessageGenerator::kNumLocates; ++locate) {
+                reader.read(locate, row);
+                keep(row.volume);
+            }
+        }
+    });
+    sd.reset();
+    SharedStats::unlink(name);
+}
+
+void snapshot_benchmarks() {
+    constexpr size_t kLocates = MessageGenerator::kNumLocates + 1;
+    std::mt19937_64 rng(13);
+    SymbolDirectory symbols;
+    SecurityStatsArray stats(kMaxLocates);
+    for (uint16_t locate = 1; locate < kLocates; ++locate) {
+        symbols.add(locate, MessageGenerator::symbol_of(locate).data());
+        for (size_t i = 0; i < 10; ++i) {
+            stats[locate].handle_trade(Trade{locate, 100 * (1 + rng() % 10), static_cast<uint32_t>(10'0000 + rng() % 500'0000), 0});
+        }
+    }
+
+    constexpr size_t kRounds = 100;
+    std::vector<std::unique_ptr<StatsSnapshot>> snapshots;
+    snapshots.push_back(std::make_unique<StatsSnapshot>());
+    benchmark("snapshot/freeze", "locates", kRounds * kLocates, [&] {
+        for (size_t round = 0; round < kRounds; ++round) {
+            snapshots[0]->freeze(stats, symbols, kLocates);
+            keep(snapshots[0]->stats[round]);
+        }
+    });
+
+    std::vector<VwapRow> rows;
+    benchmark("snapshot/collect_vwap_rows", "rows", kRounds * (kLocates - 1), [&] {
+        for (size_t round = 0; round < kRounds; ++round) {
+            collect_vwap_rows(snapshots, rows);
+        }
+        keep(rows[0]);
+    });
+
+    std::string buffer;
+    benchmark("snapshot/format_vwaps_csv", "rows", kRounds * rows.size(), [&] {
+        for (size_t round = 0; round < kRounds; ++round) {
+            format_vwaps_csv(buffer, 10, rows);
+        }
+        keep(buffer[0]);
+    });
+
+    std::vector<BarRow> bars;
+    for (const VwapRow& row: rows) {
+        const uint32_t price = static_cast<uint32_t>(row.vwap);
+        bars.push_back(BarRow{row.stock_locate, row.symbol, price, price + 100, price - 100, price, 10, row.volume, row.notional});
+    }
+    benchmark("snapshot/append_bars_csv", "rows", kRounds * bars.size(), [&] {
+        for (size_t round = 0; round < kRounds; ++round) {
+            buffer.clear();
+            append_bars_csv(buffer, uint64_t(34200) * 1'000'000'000, bars);
+        }
+        keep(buffer[0]);
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg.rfind("--repeats=", 0) == 0) {
+            g_repeats = std::max<size_t>(1, std::stoul(arg.substr(10)));
+        } else if (arg.rfind("--", 0) == 0) {
+            std::fprintf(stderr, "Usage: %s [<name filter>] [--repeats=<n>]\n", argv[0]);
+            return 1;
+        } else {
+            g_filter = arg;
+        }
+    }
+
+    // SystemData needs a writer, nothing is written: the synthetic day never crosses an hour
+    const std::filesystem::path output_dir = std::filesystem::temp_directory_path() / "itch_benchmarks";
+    SnapshotWriter writer{output_dir.string(), SnapshotWriter::PrintFormat::csv};
+
+    decode_benchmarks();
+    dispatch_benchmarks(writer);
+    system_data_benchmarks(writer);
+    shared_stats_benchmarks(writer);
+    snapshot_benchmarks();
+
+    writer.finish();
+    std::filesystem::remove_all(output_dir);
+    return 0;
+}
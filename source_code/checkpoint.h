@@ -0,0 +1,162 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "state_image.h"
+
+/*
+    Checkpoint file (--checkpoint): everything needed to pick a day up again at an hourly boundary
+        instead of from the first byte of the data file (--resume).
+
+    [CheckpointHeader]
+    output state                    what the writer had written out by then, see SnapshotWriter::save_output_
+    per shard: u64 size, image      that shard's SystemData, see SystemData::save
+    trailer magic                   8 bytes, a file without it was cut short
+
+    Images are raw memory (state_image.h), a checkpoint is only good for the build that wrote it.
+    The file is written next to its final name, synced and renamed over the previous checkpoint,
+        so there is always a complete one even if the process dies while writing.
+*/
+static constexpr char kCheckpointMagic[8] = {'I', 'T', 'C', 'H', 'C', 'K', 'P', 'T'};
+static constexpr char kCheckpointTrailerMagic[8] = {'C', 'K', 'P', 'T', 'E', 'N', 'D', '1'};
+static constexpr uint32_t kCheckpointVersion = 3;
+static constexpr const char* kCheckpointFileName = "checkpoint.bin";
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_shards;
+    uint64_t input_size;      // size of the data file (as is, compressed or not) when the run started
+    uint64_t input_device;    // st_dev and st_ino of the data file, a followed file keeps them as it grows
+    uint64_t input_inode;
+    uint64_t input_prefix_size; // how much of the start of the data file input_prefix_hash covers
+    uint64_t input_prefix_hash; // hash_file_prefix, to tell days apart without their sizes
+    uint32_t input_growing;   // 1 if the data file was followed (--follow), its size then only grows
+    uint32_t reserved;
+    uint64_t input_offset;    // where reading starts again, in the (decompressed) data
+    uint64_t timestamp;       // of the boundary
+    uint64_t bar_interval_ns;
+    uint64_t book_depth;
+    uint32_t print_format;
+    uint32_t watchlist_size;
+    uint64_t output_state_size;
+};
+
+static constexpr size_t kCheckpointPrefixSize = 64 * 1024;
+
+/* FNV-1a of the first size bytes of the file at path, 0 if it has fewer */
+inline uint64_t hash_file_prefix(const std::string& path, const size_t size) {
+    std::ifstream ifs(path, std::ios::binary);
+    std::string prefix(size, '\0');
+    if (!ifs.read(prefix.data(), static_cast<std::streamsize>(size))) {
+        return 0;
+    }
+    uint64_t hash = 14695981039346656037ull;
+    for (const char c: prefix) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+struct Checkpoint {
+    CheckpointHeader header{};
+    std::string output_state;
+    std::vector<std::string> shards;
+};
+
+/* Returns false (after printing why) if the checkpoint could not be written, the previous one is then still there */
+inline bool save_checkpoint(const std::string& path, Checkpoint& checkpoint) {
+    std::memcpy(checkpoint.header.magic, kCheckpointMagic, sizeof(kCheckpointMagic));
+    checkpoint.header.version = kCheckpointVersion;
+    checkpoint.header.num_shards = static_cast<uint32_t>(checkpoint.shards.size());
+    checkpoint.header.output_state_size = checkpoint.output_state.size();
+
+    const std::string tmp_path = path + ".tmp";
+    const int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Error opening checkpoint file " << tmp_path << std::endl;
+        return false;
+    }
+    bool ok = true;
+    auto write_all = [&](const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        while (ok && size != 0) {
+            const ssize_t n = ::write(fd, p, size);
+            if (n <= 0) {
+                ok = false;
+                break;
+            }
+            p += n;
+            size -= n;
+        }
+    };
+    write_all(&checkpoint.header, sizeof(checkpoint.header));
+    write_all(checkpoint.output_state.data(), checkpoint.output_state.size());
+    for (const std::string& image: checkpoint.shards) {
+        const uint64_t size = image.size();
+        write_all(&size, sizeof(size));
+        write_all(image.data(), image.size());
+    }
+    write_all(kCheckpointTrailerMagic, sizeof(kCheckpointTrailerMagic));
+    ok = ok && ::fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error writing checkpoint file " << tmp_path << std::endl;
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*
+    Reads a whole checkpoint file. Returns false (after printing why) if it's missing, cut short or of another version.
+    max_shards: this run's workers, a checkpoint of more shards couldn't be resumed anyway.
+*/
+inline bool load_checkpoint(const std::string& path, Checkpoint& checkpoint, const size_t max_shards) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs.is_open()) {
+        std::cerr << "No checkpoint at " << path << std::endl;
+        return false;
+    }
+    const std::string content{std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()};
+    StateReader in(content);
+    char trailer[sizeof(kCheckpointTrailerMagic)];
+    bool ok = content.size() >= sizeof(trailer)
+        && std::memcmp(content.data() + content.size() - sizeof(trailer), kCheckpointTrailerMagic, sizeof(trailer)) == 0
+        && in.get(checkpoint.header)
+        && std::memcmp(checkpoint.header.magic, kCheckpointMagic, sizeof(kCheckpointMagic)) == 0
+        && checkpoint.header.version == kCheckpointVersion
+        && checkpoint.header.output_state_size <= content.size()
+        // Every shard takes at least its size, a bigger count is a corrupt header, not something to allocate
+        && checkpoint.header.num_shards <= content.size() / sizeof(uint64_t)
+        && checkpoint.header.num_shards <= max_shards;
+    if (ok) {
+        checkpoint.output_state.resize(checkpoint.header.output_state_size);
+        ok = in.get_array(checkpoint.output_state.data(), checkpoint.output_state.size());
+    }
+    checkpoint.shards.resize(ok ? checkpoint.header.num_shards : 0);
+    for (std::string& image: checkpoint.shards) {
+        uint64_t size = 0;
+        if (!in.get(size) || size > content.size()) {
+            ok = false;
+            break;
+        }
+        image.resize(size);
+        ok = in.get_array(image.data(), size);
+    }
+    ok = ok && in.get_array(trailer, sizeof(trailer)) && in.done();
+    if (!ok) {
+        std::cerr << "Checkpoint " << path << " is incomplete or from another version" << std::endl;
+    }
+    return ok;
+}
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,96 @@
+#ifndef CHUNK_INDEX_H
+#define CHUNK_INDEX_H
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "utils.h"
+
+/*
+    Message boundaries of an ITCH file, roughly every `stride` bytes.
+    Found by one fast pass that only reads the 2-byte length prefixes,
+        so the file can then be split into chunks that start on a message and decoded in parallel.
+    The index can be saved next to the data file so the framing pass is only paid once.
+
+    offsets always starts with 0 and ends with the end of the last complete message.
+*/
+struct ChunkIndex {
+    static constexpr size_t kDefaultStride = size_t(1) << 20;
+    static constexpr char kMagic[8] = {'I', 'T', 'C', 'H', 'I', 'D', 'X', '1'};
+
+    uint64_t file_size = 0;
+    uint64_t stride = kDefaultStride;
+    std::vector<uint64_t> offsets;
+
+    void build(const char* data, const size_t size, const size_t index_stride = kDefaultStride) {
+        file_size = size;
+        stride = index_stride;
+        offsets.assign(1, 0);
+
+        uint64_t pos = 0;
+        uint64_t next_boundary = stride;
+        while (size - pos >= 2) {
+            const uint64_t msg_len = read_big_endian<2>(data + pos);
+            if (size - pos - 2 < msg_len) {
+                break; // truncated message at the end
+            }
+            pos += 2 + msg_len;
+            if (pos >= next_boundary) {
+                offsets.push_back(pos);
+                next_boundary = pos + stride;
+            }
+        }
+        if (offsets.back() != pos) {
+            offsets.push_back(pos);
+        }
+    }
+
+    /* Groups index entries into chunks of about chunk_size bytes, returns their boundaries */
+    std::vector<uint64_t> chunks(const size_t chunk_size) const {
+        std::vector<uint64_t> boundaries{0};
+        for (size_t i = 1; i < offsets.size(); ++i) {
+            if (offsets[i] - boundaries.back() >= chunk_size || i + 1 == offsets.size()) {
+                boundaries.push_back(offsets[i]);
+            }
+        }
+        return boundaries;
+    }
+
+    bool save(const std::string& path) const {
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            return false;
+        }
+        const uint64_t count = offsets.size();
+        ofs.write(kMagic, sizeof(kMagic));
+        ofs.write(reinterpret_cast<const char*>(&file_size), sizeof(file_size));
+        ofs.write(reinterpret_cast<const char*>(&stride), sizeof(stride));
+        ofs.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        ofs.write(reinterpret_cast<const char*>(offsets.data()), count * sizeof(uint64_t));
+        return ofs.good();
+    }
+
+    /* Fails if there is no index at path, or it was built for a file of another size */
+    bool load(const std::string& path, const uint64_t expected_file_size) {
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs.is_open()) {
+            return false;
+        }
+        char magic[sizeof(kMagic)];
+        uint64_t count = 0;
+        ifs.read(magic, sizeof(magic));
+        ifs.read(reinterpret_cast<char*>(&file_size), sizeof(file_size));
+        ifs.read(reinterpret_cast<char*>(&stride), sizeof(stride));
+        ifs.read(reinterpret_cast<char*>(&count), sizeof(count));
+        if (!ifs || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0
+            || file_size != expected_file_size || count < 1) {
+            return false;
+        }
+        offsets.resize(count);
+        ifs.read(reinterpret_cast<char*>(offsets.data()), count * sizeof(uint64_t));
+        return ifs.good() && offsets.front() == 0 && offsets.back() <= file_size;
+    }
+};
+
+#endif // CHUNK_INDEX_H
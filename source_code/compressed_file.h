@@ -0,0 +1,129 @@
+#ifndef COMPRESSED_FILE_H
+#define COMPRESSED_FILE_H
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef PARSER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+enum class Compression {
+    none,
+    gzip,
+    zstd
+};
+
+/* Looks at the magic bytes, not the file name */
+inline Compression detect_compression(const std::string& file_path) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    unsigned char magic[4] = {0, 0, 0, 0};
+    ifs.read(reinterpret_cast<char*>(magic), sizeof(magic));
+    if (ifs.gcount() >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return Compression::gzip;
+    }
+    if (ifs.gcount() == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+        return Compression::zstd;
+    }
+    return Compression::none;
+}
+
+#ifdef PARSER_HAVE_ZLIB
+/*
+    Streaming gzip decompression of a whole file, read() hands out the decompressed bytes in order.
+    Concatenated gzip members (what `cat a.gz b.gz` or pigz can produce) are decompressed one after the other.
+*/
+class GzipFile {
+public:
+    GzipFile() = default;
+    GzipFile(const GzipFile&) = delete;
+    GzipFile& operator=(const GzipFile&) = delete;
+    ~GzipFile() {
+        close();
+    }
+
+    bool open(const std::string& file_path) {
+        close();
+        fd_ = ::open(file_path.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            return false;
+        }
+        ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+        stream_ = z_stream{};
+        // 15 + 32: gzip or zlib header, detected automatically
+        if (inflateInit2(&stream_, 15 + 32) != Z_OK) {
+            close();
+            return false;
+        }
+        initialized_ = true;
+        input_ = std::make_unique<unsigned char[]>(kInputSize);
+        finished_ = false;
+        error_ = false;
+        return true;
+    }
+
+    /* Fills up to capacity bytes, returns how many. 0 means the end of the data, or an error (see failed()) */
+    size_t read(char* out, const size_t capacity) {
+        stream_.next_out = reinterpret_cast<unsigned char*>(out);
+        stream_.avail_out = static_cast<unsigned int>(capacity);
+        while (stream_.avail_out > 0 && !finished_) {
+            if (stream_.avail_in == 0) {
+                const ssize_t n = ::read(fd_, input_.get(), kInputSize);
+                if (n < 0) {
+                    error_ = true;
+                    break;
+                }
+                if (n == 0) {
+                    // A member cut short is an error, the end of input after a complete member is not
+                    error_ = !member_done_;
+                    finished_ = true;
+                    break;
+                }
+                stream_.next_in = input_.get();
+                stream_.avail_in = static_cast<unsigned int>(n);
+            }
+            member_done_ = false;
+            const int ret = inflate(&stream_, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                member_done_ = true;
+                inflateReset(&stream_);
+            } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                error_ = true;
+                finished_ = true;
+            }
+        }
+        return capacity - stream_.avail_out;
+    }
+
+    bool failed() const {
+        return error_;
+    }
+
+    void close() {
+        if (initialized_) {
+            inflateEnd(&stream_);
+            initialized_ = false;
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+private:
+    static constexpr size_t kInputSize = size_t(1) << 20;
+
+    int fd_ = -1;
+    z_stream stream_{};
+    bool initialized_ = false;
+    std::unique_ptr<unsigned char[]> input_;
+    bool member_done_ = false;
+    bool finished_ = false;
+    bool error_ = false;
+};
+#endif // PARSER_HAVE_ZLIB
+
+#endif // COMPRESSED_FILE_H
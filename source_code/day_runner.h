@@ -0,0 +1,227 @@
+#ifndef DAY_RUNNER_H
+#define DAY_RUNNER_H
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <system_error>
+#include <vector>
+#include <sys/stat.h>
+#include "checkpoint.h"
+#include "compressed_file.h"
+#include "message_parser.h"
+#include "message_reader.h"
+#include "options.h"
+#include "order_store.h"
+#include "security_stats.h"
+#include "shared_stats.h"
+#include "snapshot_writer.h"
+#include "stats_report.h"
+#include "system_data.h"
+
+/* The settings a checkpoint has to have been taken with to be resumed from, see checkpoint_matches_ */
+inline CheckpointHeader checkpoint_header_for(const Options& options) {
+    CheckpointHeader header{};
+    struct stat st{};
+    if (::stat(options.data_file_path.c_str(), &st) == 0) {
+        header.input_size = static_cast<uint64_t>(st.st_size);
+        header.input_device = static_cast<uint64_t>(st.st_dev);
+        header.input_inode = static_cast<uint64_t>(st.st_ino);
+    }
+    header.input_prefix_size = std::min<uint64_t>(header.input_size, kCheckpointPrefixSize);
+    header.input_prefix_hash = hash_file_prefix(options.data_file_path, header.input_prefix_size);
+    header.input_growing = options.follow;
+    header.num_shards = static_cast<uint32_t>(options.workers);
+    header.bar_interval_ns = options.bar_interval_ns;
+    header.book_depth = options.book_depth;
+    header.print_format = static_cast<uint32_t>(options.print_format);
+    header.watchlist_size = static_cast<uint32_t>(options.watchlist.size());
+    return header;
+}
+
+/*
+    A file that is not followed has to be the same size as when the checkpoint was taken. A followed one grows
+        in between, so it's told apart by its device and inode, and only has to reach where the checkpoint stopped.
+    Either way the start of the file has to be the same, as far as the checkpoint's run had it.
+*/
+static inline bool checkpoint_matches_(const CheckpointHeader& saved, const CheckpointHeader& expected,
+    const std::string& data_file_path, const std::string& path) {
+    const bool growing = saved.input_growing || expected.input_growing;
+    const bool same_file = growing
+        ? saved.input_device == expected.input_device && saved.input_inode == expected.input_inode
+            && saved.input_offset <= expected.input_size && saved.input_prefix_size <= expected.input_size
+        : saved.input_size == expected.input_size;
+    if (!same_file || hash_file_prefix(data_file_path, saved.input_prefix_size) != saved.input_prefix_hash) {
+        std::cerr << "Checkpoint " << path << " is of another data file" << std::endl;
+        return false;
+    }
+    if (saved.num_shards != expected.num_shards || saved.bar_interval_ns != expected.bar_interval_ns
+        || saved.book_depth != expected.book_depth
+        || saved.print_format != expected.print_format || saved.watchlist_size != expected.watchlist_size) {
+        std::cerr << "Checkpoint " << path << " was taken with other --workers, --bar-interval, --book-depth, format or watchlist" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+    One trading day from data file to output directory: a reader, a parser per shard,
+        a SystemData per shard and a snapshot writer, all of them this day's own.
+    Several days can run at the same time in one process (see BatchRunner), they share nothing.
+    verbose: print the settings and the memory used by each shard to stdout, as a single run does.
+    Returns false if the data file (or the checkpoint it was resumed from) could not be read.
+*/
+inline bool run_day(const Options& options, const bool verbose = true) {
+    if (verbose) {
+        std::cout << "Data file is: " << options.data_file_path << std::endl;
+        std::cout << "Output log directory is: " << options.output_dir_path << std::endl;
+        std::cout << "Output format is: " << options.print_format_str << std::endl;
+
+        if (!options.watchlist.empty()) {
+            std::cout << "Watchlist: " << options.watchlist.size() << " symbols" << std::endl;
+        }
+    }
+
+    const size_t num_shards = options.workers;
+    // The reader sends the snapshot boundaries when it shards or filters the messages, and for checkpoints
+    const bool external_boundaries = num_shards > 1 || !options.watchlist.empty() || options.checkpoint || reads_live(options);
+
+    const std::string checkpoint_path = (std::filesystem::path(options.output_dir_path) / kCheckpointFileName).string();
+    // Stats (and hashes the start of) the data file, only done when there are checkpoints
+    const CheckpointHeader checkpoint_header = options.checkpoint || options.resume
+        ? checkpoint_header_for(options) : CheckpointHeader{};
+    Checkpoint checkpoint;
+    bool resuming = options.resume && load_checkpoint(checkpoint_path, checkpoint, num_shards)
+        && checkpoint_matches_(checkpoint.header, checkpoint_header, options.data_file_path, checkpoint_path);
+
+    SnapshotWriter writer{options.output_dir_path, options.print_format, num_shards, options.bar_interval_ns != 0,
+        options.book_depth != 0, resuming ? &checkpoint : nullptr};
+    resuming = resuming && writer.resumed();
+    if (reads_live(options)) {
+        writer.write_as_submitted();
+    }
+    if (options.checkpoint) {
+        if (!resuming) {
+            // Left by an earlier run, it doesn't go with the output this run starts over
+            std::remove(checkpoint_path.c_str());
+        }
+        writer.enable_checkpoints(checkpoint_path, checkpoint_header);
+    }
+    if (options.resume && !resuming) {
+        std::cerr << "Not resuming, " << options.data_file_path << " is processed from the beginning" << std::endl;
+    }
+
+    std::vector<std::unique_ptr<SystemData>> shards;
+    for (size_t i = 0; i < num_shards; ++i) {
+        shards.push_back(std::make_unique<SystemData>(
+            writer, options.expected_orders / num_shards, external_boundaries, options.bar_interval_ns, options.book_depth));
+        if (options.checkpoint) {
+            shards.back()->enable_checkpoints(i);
+        }
+    }
+
+    MessageReader msg_reader(options);
+    if (resuming) {
+        for (size_t i = 0; i < num_shards; ++i) {
+            StateReader image(checkpoint.shards[i]);
+            if (!shards[i]->load(image)) {
+                std::cerr << "Error loading checkpoint " << checkpoint_path << std::endl;
+                return false;
+            }
+            msg_reader.restore_watchlist(shards[i]->symbols());
+        }
+        msg_reader.resume_from(checkpoint.header.input_offset, checkpoint.header.timestamp);
+        if (verbose) {
+            std::cout << "Resuming at hour " << get_hour_by_timestamp(checkpoint.header.timestamp)
+            << ", byte " << checkpoint.header.input_offset << " of the data" << std::endl;
+        }
+        checkpoint = Checkpoint{};
+    }
+
+    SharedStats shared_stats;
+    if (!options.shm_name.empty() && shared_stats.open(options.shm_name)) {
+        for (auto& shard: shards) {
+            shard->enable_shared_stats(shared_stats);
+        }
+        if (verbose) {
+            std::cout << "Publishing live stats in shared memory " << shared_stats.name() << std::endl;
+        }
+    }
+    msg_reader.start_reading();
+
+    // Process times are only sampled for the stats file
+    const uint64_t latency_sample = options.stats_path.empty() ? 0 : options.latency_sample;
+    std::vector<std::unique_ptr<MessageParser>> msg_parsers;
+    for (size_t i = 0; i < num_shards; ++i) {
+        msg_parsers.push_back(std::make_unique<MessageParser>(msg_reader, *shards[i], i, latency_sample));
+        msg_parsers.back()->start_parsing();
+    }
+
+    std::unique_ptr<StatsReport> stats;
+    if (!options.stats_path.empty()) {
+        stats = std::make_unique<StatsReport>(options.stats_path, options.stats_interval_ns, msg_reader, msg_parsers, writer);
+        if (!stats->start()) {
+            stats.reset();
+        }
+    }
+
+    msg_reader.stop_reading();
+    for (auto& msg_parser: msg_parsers) {
+        msg_parser->stop_parsing();
+    }
+    shared_stats.finish();
+    writer.finish();
+    if (stats) {
+        stats->finish();
+    }
+
+    if (verbose) {
+        if (msg_reader.reads_feed()) {
+            const FeedMetrics& feed = msg_reader.feed_metrics();
+            std::cout << "Feed: " << feed.packets.get() << " packets, " << feed.gaps.get() << " gaps ("
+            << feed.lost.get() << " messages lost), " << feed.duplicates.get() << " duplicate messages, "
+            << feed.malformed.get() << " malformed packets" << std::endl;
+        }
+        const LatencyHistogram& latency = writer.output_latency();
+        if (latency.count() != 0) {
+            std::cout << "Tick to output: " << latency.count() << " boundaries, p50 " << latency.quantile(0.5) / 1000
+            << " us, p99 " << latency.quantile(0.99) / 1000 << " us, max " << latency.max() / 1000 << " us" << std::endl;
+        }
+        for (size_t i = 0; i < num_shards; ++i) {
+            if (num_shards > 1) {
+                std::cout << "Shard " << i << ":" << std::endl;
+            }
+            shards[i]->print_memory_usage(std::cout);
+        }
+    }
+    return !msg_reader.failed();
+}
+
+/*
+    Rough peak memory of run_day on a file, for scheduling days side by side (not counting the file's page cache).
+    The order store keeps every order added during the day, it is most of it: one order per
+        kFileBytesPerOrder bytes of (uncompressed) file, never less than --expected-orders.
+    Everything else is sized up front: per-locate stats, the frozen copies of them the writer keeps, the rings.
+*/
+inline uint64_t estimate_day_memory(const Options& options, const std::string& data_file_path) {
+    constexpr uint64_t kFileBytesPerOrder = 64; // ~40% of messages are adds in NASDAQ files
+    constexpr uint64_t kGzipRatio = 4;          // ITCH files shrink about 4x with gzip
+    std::error_code error;
+    uint64_t file_size = std::filesystem::file_size(data_file_path, error);
+    if (error) {
+        file_size = 0;
+    }
+    if (detect_compression(data_file_path) != Compression::none) {
+        file_size *= kGzipRatio;
+    }
+    const uint64_t orders = std::max<uint64_t>(options.expected_orders, file_size / kFileBytesPerOrder);
+    const size_t num_shards = options.workers;
+    const size_t num_rings = num_shards + (options.decoders > 1 ? options.decoders : 0);
+    return num_shards * OrderStore::memory_for(orders / num_shards)
+        + 3 * num_shards * kMaxLocates * (sizeof(SecurityStats) + sizeof(SymbolDirectory::Symbol))
+        + num_rings * options.queue_capacity * sizeof(Message);
+}
+
+#endif // DAY_RUNNER_H
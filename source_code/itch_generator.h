@@ -0,0 +1,599 @@
+#ifndef ITCH_GENERATOR_H
+#define ITCH_GENERATOR_H
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include "message_types.h"
+#include "symbol_directory.h"
+
+/* Writes value big endian into the field F of a message body */
+template <typename F>
+inline void put_field(char* body, const uint64_t value) {
+    for (size_t i = 0; i < F::width; ++i) {
+        body[F::offset + F::width - 1 - i] = static_cast<char>(value >> (8 * i));
+    }
+}
+
+/*
+    Appends framed ITCH 5.0 messages (2 byte length, type, body) to a buffer.
+    Fields are put where the Layouts of message_types.h read them from,
+        fields the parser doesn't read are filled with something plausible or left zero.
+    Symbols are the raw 8 bytes (right padded with spaces).
+*/
+class ItchEncoder {
+public:
+    explicit ItchEncoder(std::string& out): out_{out} {}
+
+    void system_event(const uint64_t timestamp, const char event_code) {
+        char* body = frame_('S', 11, 0, timestamp);
+        body[SystemEventMessage::Layout::event_code::offset] = event_code;
+    }
+
+    void stock_directory(const uint64_t timestamp, const uint16_t locate, const char* symbol) {
+        char* body = frame_('R', 38, locate, timestamp);
+        std::memcpy(body + StockDirectoryMessage::Layout::stock::offset, symbol, kSymbolLength);
+        body[18] = 'Q'; // market category
+        body[19] = 'N'; // financial status
+        put_field<Field<20, 4>>(body, 100); // round lot size
+        std::memset(body + 24, 'N', 14);
+    }
+
+    /* Stock Trading Action, not decoded by the parser */
+    void trading_action(const uint64_t timestamp, const uint16_t locate, const char* symbol) {
+        char* body = frame_('H', 24, locate, timestamp);
+        std::memcpy(body + 10, symbol, kSymbolLength);
+        body[18] = 'T'; // trading
+    }
+
+    /* Add Order, or Add Order with MPID Attribution ('F') if mpid */
+    void add_order(const uint64_t timestamp, const uint16_t locate, const uint64_t reference, const char side,
+        const uint32_t shares, const char* symbol, const uint32_t price, const bool mpid = false) {
+        using Layout = AddOrderMPIDAttributionMessage::Layout;
+        char* body = frame_(mpid ? 'F' : 'A', mpid ? 39 : 35, locate, timestamp);
+        put_field<Layout::order_reference_number>(body, reference);
+        body[Layout::side::offset] = side;
+        put_field<Layout::shares>(body, shares);
+        std::memcpy(body + Layout::stock::offset, symbol, kSymbolLength);
+        put_field<Layout::price>(body, price);
+        if (mpid) {
+            std::memcpy(body + Layout::attribution::offset, "GNRT", 4);
+        }
+    }
+
+    void order_executed(const uint64_t timestamp, const uint16_t locate, const uint64_t reference,
+        const uint32_t shares, const uint64_t match_number) {
+        using Layout = OrderExecutedMessage::Layout;
+        char* body = frame_('E', 30, locate, timestamp);
+        put_field<Layout::order_reference_number>(body, reference);
+        put_field<Layout::executed_shares>(body, shares);
+        put_field<Layout::match_number>(body, match_number);
+    }
+
+    void order_executed_with_price(const uint64_t timestamp, const uint16_t locate, const uint64_t reference,
+        const uint32_t shares, const uint64_t match_number, const bool printable, const uint32_t price) {
+        using Layout = OrderExecutedWithPriceMessage::Layout;
+        char* body = frame_('C', 35, locate, timestamp);
+        put_field<Layout::order_reference_number>(body, reference);
+        put_field<Layout::executed_shares>(body, shares);
+        put_field<Layout::match_number>(body, match_number);
+        body[Layout::printable::offset] = printable ? 'Y' : 'N';
+        put_field<Layout::execution_price>(body, price);
+    }
+
+    /* Order Cancel (partial), only decoded by the parser with the order book (--book-depth) */
+    void order_cancel(const uint64_t timestamp, const uint16_t locate, const uint64_t reference, const uint32_t shares) {
+        char* body = frame_('X', 22, locate, timestamp);
+        put_field<Field<10, 8>>(body, reference);
+        put_field<Field<18, 4>>(body, shares);
+    }
+
+    /* Order Delete, only decoded by the parser with the order book (--book-depth) */
+    void order_delete(const uint64_t timestamp, const uint16_t locate, const uint64_t reference) {
+        char* body = frame_('D', 18, locate, timestamp);
+        put_field<Field<10, 8>>(body, reference);
+    }
+
+    void order_replace(const uint64_t timestamp, const uint16_t locate, const uint64_t reference,
+        const uint64_t new_reference, const uint32_t shares, const uint32_t price) {
+        using Layout = OrderReplaceMessage::Layout;
+        char* body = frame_('U', 34, locate, timestamp);
+        put_field<Layout::original_order_reference_number>(body, reference);
+        put_field<Layout::new_order_reference_number>(body, new_reference);
+        put_field<Layout::shares>(body, shares);
+        put_field<Layout::price>(body, price);
+    }
+
+    /* Non-cross trade against a non-displayed order */
+    void trade(const uint64_t timestamp, const uint16_t locate, const uint32_t shares, const char* symbol,
+        const uint32_t price, const uint64_t match_number) {
+        using Layout = TradeMessage::Layout;
+        char* body = frame_('P', 43, locate, timestamp);
+        body[Layout::side::offset] = 'B';
+        put_field<Layout::shares>(body, shares);
+        std::memcpy(body + Layout::stock::offset, symbol, kSymbolLength);
+        put_field<Layout::price>(body, price);
+        put_field<Layout::match_number>(body, match_number);
+    }
+
+    /* cross_type 'O' opening, 'C' closing */
+    void cross_trade(const uint64_t timestamp, const uint16_t locate, const uint64_t shares, const char* symbol,
+        const uint32_t price, const uint64_t match_number, const char cross_type) {
+        using Layout = CrossTradeMessage::Layout;
+        char* body = frame_('Q', 39, locate, timestamp);
+        put_field<Layout::shares>(body, shares);
+        std::memcpy(body + Layout::stock::offset, symbol, kSymbolLength);
+        put_field<Layout::cross_price>(body, price);
+        put_field<Layout::match_number>(body, match_number);
+        body[Layout::cross_type::offset] = cross_type;
+    }
+
+    void broken_trade(const uint64_t timestamp, const uint16_t locate, const uint64_t match_number) {
+        char* body = frame_('B', 18, locate, timestamp);
+        put_field<BrokenTradeMessage::Layout::match_number>(body, match_number);
+    }
+
+    /* Net Order Imbalance Indicator ahead of a cross, not decoded by the parser */
+    void imbalance(const uint64_t timestamp, const uint16_t locate, const char* symbol, const uint32_t price,
+        const char cross_type) {
+        char* body = frame_('I', 49, locate, timestamp);
+        put_field<Field<10, 8>>(body, 1000); // paired shares
+        put_field<Field<18, 8>>(body, 100); // imbalance shares
+        body[26] = 'B';
+        std::memcpy(body + 27, symbol, kSymbolLength);
+        put_field<Field<35, 4>>(body, price); // far price
+        put_field<Field<39, 4>>(body, price); // near price
+        put_field<Field<43, 4>>(body, price); // reference price
+        body[47] = cross_type;
+        body[48] = 'L';
+    }
+
+private:
+    std::string& out_;
+
+    /* Appends the frame, header filled in, returns the body (right after the type) */
+    char* frame_(const char type, const size_t body_size, const uint16_t locate, const uint64_t timestamp) {
+        const size_t start = out_.size();
+        out_.resize(start + 3 + body_size, '\0');
+        char* frame = out_.data() + start;
+        frame[0] = static_cast<char>((body_size + 1) >> 8);
+        frame[1] = static_cast<char>(body_size + 1);
+        frame[2] = type;
+        char* body = frame + 3;
+        put_field<MessageHeader::Layout::stock_locate>(body, locate);
+        put_field<MessageHeader::Layout::timestamp>(body, timestamp);
+        return body;
+    }
+};
+
+/* What a generated day looks like, see ItchGenerator */
+struct GeneratorConfig {
+    uint64_t seed = 1;
+    size_t symbols = 8000;
+    size_t orders = 1'000'000; // orders added over the day, replaces not counted
+
+    // What happens to an order, the rest are deleted ('D')
+    double execute_ratio = 0.10; // executed ('E', 1 in 10 'C'), maybe in two parts
+    double replace_ratio = 0.15; // replaced ('U'), the new order gets a fate of its own
+    double cancel_ratio = 0.10; // partly cancelled ('X') first
+    double break_ratio = 0.01; // of executions and trades, broken ('B') a little later
+    double trade_ratio = 0.05; // non-displayed trades ('P') per order added
+    double mean_lifetime_s = 30; // how long an order lives, on average (exponential)
+
+    // Timeline, ns since midnight. Orders are spread over [start, end), with extended_share of them outside
+    //  [open, close) and the rest U-shaped over the regular session (busiest at the open and the close)
+    uint64_t start_ns = uint64_t(4) * 3600 * 1'000'000'000;
+    uint64_t open_ns = uint64_t(9 * 3600 + 1800) * 1'000'000'000;
+    uint64_t close_ns = uint64_t(16) * 3600 * 1'000'000'000;
+    uint64_t end_ns = uint64_t(20) * 3600 * 1'000'000'000;
+    double extended_share = 0.05;
+};
+
+/*
+    Simulates a trading day and writes it as ITCH 5.0, deterministic for a given config (seed included):
+        the same config gives the same bytes, on any machine with the same standard library.
+    Every symbol gets a Stock Directory and a Trading Action message, and an opening and closing cross
+        (with an imbalance message before it). Orders are added on a timeline following GeneratorConfig,
+        and each one is, after an exponential lifetime, executed, replaced or deleted.
+    Executions, replaces and deletes only ever refer to live orders, with the shares they have left,
+        timestamps never go backwards, so the file is what the parser expects from a real day.
+    Messages the parser always skips (H, I) are in there too, for the skip path, as are Order Cancel
+        and Order Delete (X, D), which it only decodes with the order book (--book-depth).
+*/
+class ItchGenerator {
+public:
+    /* Message counts by type, bytes, and the busiest second */
+    struct Summary {
+        std::array<uint64_t, 256> messages{};
+        uint64_t total_messages = 0;
+        uint64_t bytes = 0;
+        uint64_t peak_second = 0; // start of it, ns since midnight, from GeneratorConfig::start_ns on
+        uint64_t peak_messages = 0;
+    };
+
+    explicit ItchGenerator(const GeneratorConfig& config)
+    : config_{config}, rng_{config.seed}, encoder_{buffer_} {
+        build_timeline_();
+        symbols_.resize(config_.symbols);
+        prices_.resize(config_.symbols);
+        for (size_t i = 0; i < config_.symbols; ++i) {
+            symbols_[i] = symbol_of(i);
+            prices_[i] = static_cast<uint32_t>(1'0000 + uniform_(500'0000));
+        }
+    }
+
+    /*
+        Generates the day, handing the bytes to write(const char* data, size_t size) in chunks of about flush_size.
+        write returns false to stop early (e.g. on an I/O error), generate then returns false too.
+    */
+    template <typename Write>
+    bool generate(Write&& write, const size_t flush_size = size_t(1) << 20) {
+        const auto flush = [&](const bool force) {
+            if (buffer_.empty() || (!force && buffer_.size() < flush_size)) {
+                return true;
+            }
+            count_messages_();
+            const bool ok = write(buffer_.data(), buffer_.size());
+            buffer_.clear();
+            return ok;
+        };
+
+        const uint64_t directory_time = config_.start_ns - std::min<uint64_t>(config_.start_ns, kSecond * 1800);
+        encoder_.system_event(directory_time, 'O');
+        for (size_t i = 0; i < config_.symbols; ++i) {
+            encoder_.stock_directory(directory_time + i, locate_of_(i), symbols_[i].data());
+            encoder_.trading_action(directory_time + i, locate_of_(i), symbols_[i].data());
+        }
+        encoder_.system_event(config_.start_ns, 'S');
+        schedule_(config_.open_ns, Event::kMarketOpen, 0);
+        schedule_(config_.close_ns, Event::kMarketClose, 0);
+        for (size_t i = 0; i < config_.symbols; ++i) {
+            schedule_(config_.open_ns - kSecond * 60, Event::kImbalance, i);
+            schedule_(config_.open_ns, Event::kOpeningCross, i);
+            schedule_(config_.close_ns - kSecond * 60, Event::kImbalance, i);
+            schedule_(config_.close_ns, Event::kClosingCross, i);
+        }
+
+        for (size_t added = 0; added < config_.orders || !events_.empty();) {
+            const uint64_t add_time = added < config_.orders ? add_time_(added) : ~uint64_t(0);
+            if (events_.empty() || add_time < events_.top().time) {
+                add_order_(add_time);
+                ++added;
+            } else {
+                const Event event = events_.top();
+                events_.pop();
+                handle_(event);
+            }
+            if (!flush(false)) {
+                return false;
+            }
+        }
+
+        encoder_.system_event(config_.end_ns, 'E');
+        encoder_.system_event(config_.end_ns + kSecond * 300, 'C');
+        return flush(true);
+    }
+
+    const Summary& summary() const {
+        return summary_;
+    }
+
+    /* Symbol of the i-th security: raw 8 bytes, right padded with spaces */
+    static SymbolDirectory::Symbol symbol_of(const size_t i) {
+        SymbolDirectory::Symbol symbol;
+        symbol.fill(' ');
+        // AAAA, AAAB, ... so symbols look like symbols and sort like their locates, 26^4 is more than enough
+        size_t n = i;
+        for (size_t pos = 4; pos-- > 0;) {
+            symbol[pos] = static_cast<char>('A' + n % 26);
+            n /= 26;
+        }
+        return symbol;
+    }
+
+private:
+    static constexpr uint64_t kSecond = 1'000'000'000;
+    static constexpr size_t kTimelineBuckets = 24 * 60; // minutes
+
+    struct Event {
+        enum Kind: uint8_t {
+            kExecute,
+            kReplace,
+            kDelete,
+            kCancel,
+            kBreak,
+            kImbalance,
+            kOpeningCross,
+            kClosingCross,
+            kMarketOpen,
+            kMarketClose
+        };
+        uint64_t time;
+        uint64_t sequence; // ties go in the order events were scheduled
+        Kind kind;
+        uint64_t target; // order slot, symbol index or match number
+        uint16_t locate; // breaks only
+
+        bool operator>(const Event& other) const {
+            return time != other.time ? time > other.time : sequence > other.sequence;
+        }
+    };
+
+    struct LiveOrder {
+        uint64_t reference;
+        size_t symbol;
+        uint32_t shares;
+        uint32_t price;
+    };
+
+    GeneratorConfig config_;
+    std::mt19937_64 rng_;
+    std::string buffer_;
+    ItchEncoder encoder_;
+    Summary summary_;
+    uint64_t current_second_ = ~uint64_t(0);
+    uint64_t current_second_messages_ = 0;
+
+    std::vector<SymbolDirectory::Symbol> symbols_;
+    std::vector<uint32_t> prices_; // last price of each symbol, moves a little with every order
+    std::vector<double> timeline_; // cumulative share of the orders added by the end of each bucket
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;
+    uint64_t next_sequence_ = 0;
+    std::vector<LiveOrder> orders_; // slots, reused once an order is gone
+    std::vector<size_t> free_slots_;
+    uint64_t next_reference_ = 1;
+    uint64_t next_match_ = 1;
+    uint64_t last_time_ = 0;
+
+    /* Plain arithmetic on the raw engine output: std distributions differ between standard libraries */
+    uint64_t uniform_(const uint64_t n) {
+        return rng_() % n;
+    }
+
+    double uniform01_() {
+        return static_cast<double>(rng_() >> 11) * 0x1.0p-53;
+    }
+
+    bool chance_(const double p) {
+        return uniform01_() < p;
+    }
+
+    uint16_t locate_of_(const size_t symbol) const {
+        return static_cast<uint16_t>(symbol + 1);
+    }
+
+    void build_timeline_() {
+        const uint64_t bucket_ns = 60 * kSecond;
+        std::vector<double> weights(kTimelineBuckets, 0.0);
+        double extended = 0, regular = 0;
+        for (size_t b = 0; b < kTimelineBuckets; ++b) {
+            const uint64_t t = b * bucket_ns;
+            if (t < config_.start_ns || t >= config_.end_ns) {
+                continue;
+            }
+            if (t < config_.open_ns || t >= config_.close_ns) {
+                weights[b] = -1; // filled in below
+                extended += 1;
+            } else {
+                // U shape: 4 times busier at the open and the close than at midday
+                const double x = double(t - config_.open_ns) / double(config_.close_ns - config_.open_ns);
+                weights[b] = 1 + 3 * (2 * x - 1) * (2 * x - 1);
+                regular += weights[b];
+            }
+        }
+        const double extended_share = extended == 0 ? 0 : (regular == 0 ? 1 : config_.extended_share);
+        timeline_.resize(kTimelineBuckets);
+        double cumulative = 0;
+        for (size_t b = 0; b < kTimelineBuckets; ++b) {
+            if (weights[b] < 0) {
+                cumulative += extended_share / extended;
+            } else if (weights[b] > 0) {
+                cumulative += (1 - extended_share) * weights[b] / regular;
+            }
+            timeline_[b] = cumulative;
+        }
+    }
+
+    /* When the i-th order is added: orders are spread over the timeline, in order */
+    uint64_t add_time_(const size_t i) const {
+        const double q = (double(i) + 0.5) / double(config_.orders) * timeline_.back();
+        const size_t b = std::upper_bound(timeline_.begin(), timeline_.end(), q) - timeline_.begin();
+        const double before = b == 0 ? 0 : timeline_[b - 1];
+        const double within = (q - before) / (timeline_[b] - before);
+        const uint64_t t = b * 60 * kSecond + static_cast<uint64_t>(within * 60 * kSecond);
+        return std::clamp(t, config_.start_ns, config_.end_ns - 1);
+    }
+
+    void schedule_(const uint64_t time, const Event::Kind kind, const uint64_t target, const uint16_t locate = 0) {
+        events_.push(Event{std::min(time, config_.end_ns - 1), next_sequence_++, kind, target, locate});
+    }
+
+    uint64_t lifetime_() {
+        return static_cast<uint64_t>(-std::log(1 - uniform01_()) * config_.mean_lifetime_s * kSecond);
+    }
+
+    /* A price near the symbol's last one, which drifts a little */
+    uint32_t price_near_(const size_t symbol) {
+        uint32_t& price = prices_[symbol];
+        const uint32_t step = std::max<uint32_t>(1, price / 1000);
+        price = uniform_(2) ? price + step : std::max<uint32_t>(step, price - step);
+        return price - static_cast<uint32_t>(uniform_(5)) * step;
+    }
+
+    /* Busier symbols have lower locates, like a popularity ranking */
+    size_t random_symbol_() {
+        const double u = uniform01_();
+        return std::min(config_.symbols - 1, static_cast<size_t>(u * u * u * config_.symbols));
+    }
+
+    uint64_t now_(const uint64_t time) {
+        last_time_ = std::max(last_time_, time);
+        return last_time_;
+    }
+
+    void add_order_(const uint64_t time) {
+        const uint64_t t = now_(time);
+        size_t slot;
+        if (!free_slots_.empty()) {
+            slot = free_slots_.back();
+            free_slots_.pop_back();
+        } else {
+            slot = orders_.size();
+            orders_.emplace_back();
+        }
+        LiveOrder& order = orders_[slot];
+        order.reference = next_reference_++;
+        order.symbol = random_symbol_();
+        order.shares = static_cast<uint32_t>(100 * (1 + uniform_(10)));
+        order.price = price_near_(order.symbol);
+        encoder_.add_order(t, locate_of_(order.symbol), order.reference, uniform_(2) ? 'B' : 'S', order.shares,
+            symbols_[order.symbol].data(), order.price, chance_(0.05));
+        decide_fate_(slot, t);
+
+        if (chance_(config_.trade_ratio)) {
+            const size_t symbol = random_symbol_();
+            const uint64_t match_number = next_match_++;
+            encoder_.trade(t, locate_of_(symbol), static_cast<uint32_t>(100 * (1 + uniform_(5))),
+                symbols_[symbol].data(), price_near_(symbol), match_number);
+            maybe_break_(t, match_number, locate_of_(symbol));
+        }
+    }
+
+    void decide_fate_(const size_t slot, const uint64_t time) {
+        const uint64_t fate_time = time + lifetime_();
+        if (chance_(config_.cancel_ratio)) {
+            schedule_(time + (fate_time - time) / 2, Event::kCancel, slot);
+        }
+        const double dice = uniform01_();
+        if (dice < config_.execute_ratio) {
+            schedule_(fate_time, Event::kExecute, slot);
+        } else if (dice < config_.execute_ratio + config_.replace_ratio) {
+            schedule_(fate_time, Event::kReplace, slot);
+        } else {
+            schedule_(fate_time, Event::kDelete, slot);
+        }
+    }
+
+    void maybe_break_(const uint64_t time, const uint64_t match_number, const uint16_t locate) {
+        if (chance_(config_.break_ratio)) {
+            schedule_(time + kSecond * (1 + uniform_(60)), Event::kBreak, match_number, locate);
+        }
+    }
+
+    void free_(const size_t slot) {
+        free_slots_.push_back(slot);
+    }
+
+    void handle_(const Event& event) {
+        const uint64_t t = now_(event.time);
+        switch (event.kind) {
+            case Event::kExecute: {
+                LiveOrder& order = orders_[event.target];
+                // Sometimes in two parts, the rest executed later
+                const bool partial = order.shares > 100 && chance_(0.25);
+                const uint32_t shares = partial ? order.shares / 2 : order.shares;
+                const uint64_t match_number = next_match_++;
+                if (chance_(0.1)) {
+                    encoder_.order_executed_with_price(t, locate_of_(order.symbol), order.reference, shares,
+                        match_number, chance_(0.9), order.price);
+                } else {
+                    encoder_.order_executed(t, locate_of_(order.symbol), order.reference, shares, match_number);
+                }
+                maybe_break_(t, match_number, locate_of_(order.symbol));
+                order.shares -= shares;
+                if (partial) {
+                    schedule_(t + lifetime_(), Event::kExecute, event.target);
+                } else {
+                    free_(event.target);
+                }
+                break;
+            }
+            case Event::kReplace: {
+                LiveOrder& order = orders_[event.target];
+                const uint64_t new_reference = next_reference_++;
+                order.shares = static_cast<uint32_t>(100 * (1 + uniform_(10)));
+                order.price = price_near_(order.symbol);
+                encoder_.order_replace(t, locate_of_(order.symbol), order.reference, new_reference,
+                    order.shares, order.price);
+                order.reference = new_reference;
+                decide_fate_(event.target, t);
+                break;
+            }
+            case Event::kDelete: {
+                const LiveOrder& order = orders_[event.target];
+                encoder_.order_delete(t, locate_of_(order.symbol), order.reference);
+                free_(event.target);
+                break;
+            }
+            case Event::kCancel: {
+                // Scheduled before the order's fate, so the order is still live
+                LiveOrder& order = orders_[event.target];
+                if (order.shares > 100) {
+                    encoder_.order_cancel(t, locate_of_(order.symbol), order.reference, 100);
+                    order.shares -= 100;
+                }
+                break;
+            }
+            case Event::kBreak: {
+                encoder_.broken_trade(t, event.locate, event.target);
+                break;
+            }
+            case Event::kImbalance: {
+                const size_t symbol = event.target;
+                encoder_.imbalance(t, locate_of_(symbol), symbols_[symbol].data(), prices_[symbol],
+                    t < config_.close_ns - kSecond * 60 ? 'O' : 'C');
+                break;
+            }
+            case Event::kOpeningCross:
+            case Event::kClosingCross: {
+                const size_t symbol = event.target;
+                const uint64_t match_number = next_match_++;
+                encoder_.cross_trade(t, locate_of_(symbol), 1000 * (1 + uniform_(50)), symbols_[symbol].data(),
+                    prices_[symbol], match_number, event.kind == Event::kOpeningCross ? 'O' : 'C');
+                break;
+            }
+            case Event::kMarketOpen: {
+                encoder_.system_event(t, 'Q');
+                break;
+            }
+            case Event::kMarketClose: {
+                encoder_.system_event(t, 'M');
+                break;
+            }
+        }
+    }
+
+    /* Walks the messages appended since the last call, for the summary */
+    void count_messages_() {
+        const char* pos = buffer_.data();
+        const char* const end = pos + buffer_.size();
+        while (pos < end) {
+            const uint16_t msg_len = read_big_endian<2>(pos);
+            const char* body = pos + 3;
+            summary_.messages[static_cast<uint8_t>(pos[2])]++;
+            summary_.total_messages++;
+            const uint64_t timestamp = read_field<MessageHeader::Layout::timestamp>(body);
+            pos += 2 + msg_len;
+            if (timestamp < config_.start_ns) {
+                continue; // the directory burst before the day starts doesn't count
+            }
+            const uint64_t second = timestamp / kSecond;
+            if (second != current_second_) {
+                current_second_ = second;
+                current_second_messages_ = 0;
+            }
+            if (++current_second_messages_ > summary_.peak_messages) {
+                summary_.peak_messages = current_second_messages_;
+                summary_.peak_second = second * kSecond;
+            }
+        }
+        summary_.bytes += buffer_.size();
+    }
+};
+
+#endif // ITCH_GENERATOR_H
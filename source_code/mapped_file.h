@@ -0,0 +1,87 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+#include <cstddef>
+#include <string>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+    Read-only mmap of a whole file.
+    The tick data is only ever walked front to back once,
+        so tell the kernel to read ahead aggressively and drop pages behind us.
+*/
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const std::string& file_path) {
+        close();
+        fd_ = ::open(file_path.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd_, &st) != 0) {
+            close();
+            return false;
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ == 0) {
+            // Nothing to map, but an empty file is still a valid (empty) input
+            return true;
+        }
+        void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (addr == MAP_FAILED) {
+            close();
+            return false;
+        }
+        data_ = static_cast<const char*>(addr);
+
+        // Hints only, failures are harmless
+        ::madvise(addr, size_, MADV_SEQUENTIAL);
+        ::madvise(addr, size_, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+        ::madvise(addr, size_, MADV_HUGEPAGE);
+#endif
+        return true;
+    }
+
+    void close() {
+        if (data_ != nullptr) {
+            ::munmap(const_cast<char*>(data_), size_);
+            data_ = nullptr;
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        size_ = 0;
+    }
+
+    bool is_open() const {
+        return fd_ >= 0;
+    }
+
+    const char* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    int fd_ = -1;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+#endif // MAPPED_FILE_H
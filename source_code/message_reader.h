@@ -1,23 +1,171 @@
 #ifndef MESSAGE_READER_H
 #define MESSAGE_READER_H
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <iostream>
-#include <mutex>
-#include <condition_variable>
-#include <queue>
+#include <fstream>
+#include <atomic>
 #include <thread>
-#include <unordered_map>
+#include <memory>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "chunk_index.h"
+#include "compressed_file.h"
 #include "message_types.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "network_feed.h"
+#include "options.h"
+#include "spsc_ring.h"
+#include "watchlist.h"
+
+/*
+    Reads and decodes the data file on its own thread and hands messages to the parser(s).
+    With one worker, messages are decoded straight into the parser's ring.
+    With N workers, every message goes to the shard that owns its stock locate (locate % N),
+        system events go to every shard, and the reader tells every shard when the stream crosses
+        a snapshot boundary (an hour, or a bar with --bar-interval) so they all snapshot at the same message.
+    With K decoders (mmap only), the file is split into chunks decoded by K threads in parallel,
+        and the reader thread puts them back in order, see read_chunked_.
+    Compressed (gzip) files are detected by their magic bytes and decompressed on a thread of their own,
+        the reader frames and decodes the decompressed chunks as they come, see read_compressed_.
+    With a watchlist, messages of other locates are dropped as soon as they are framed, by peeking
+        at their locate, before anything is decoded (see watched_). The reader then sends the snapshot
+        boundaries itself, also for the messages it dropped, so snapshots happen at the same points as without one.
+    Every thread that frames messages counts them (DecodeMetrics), the stats file reads them from here.
+    Live input (--follow, or stdin) is read with read(2) as it comes, see read_live_.
+    So is a feed (network_feed.h): MoldUDP64 datagrams, a batch per system call (read_mold_), or a
+        SoupBinTCP stream (read_soup_). The ITCH messages inside are decoded as if they came from a file,
+        the sequence numbers around them are checked for gaps.
+    With checkpoints the reader sends the boundaries too, each with the input offset of the message that
+        crossed it, which is where a resumed run starts reading again (resume_from).
+*/
+
+/* Set (from a signal handler) to stop reading live input, what was read so far is still processed and written */
+inline std::atomic<bool>& live_stop_requested() {
+    static std::atomic<bool> requested{false};
+    return requested;
+}
+
+/* What a thread framing the file saw: every message by Message Type byte, and the ones of types nothing reads */
+struct DecodeMetrics {
+    TypeCounters messages;
+    TypeCounters skipped;
+    TypeCounters malformed; // shorter than their type's Layout, skipped
+    Counter bytes; // length prefixes included
+    StageTime time;
+};
 
 class MessageReader {
 public:
-    MessageReader(const std::string& file_path): file_path_{file_path} {}
+    using MessageRing = SpscRing<Message>;
+
+    MessageReader(const Options& options)
+    : file_path_{options.data_file_path}, read_mode_{options.read_mode},
+    num_decoders_{options.decoders}, chunk_size_{options.chunk_size}, chunk_index_path_{options.chunk_index_path},
+    queue_capacity_{options.queue_capacity}, queue_batch_{options.queue_batch}, wait_strategy_{options.wait_strategy},
+    bar_interval_ns_{options.bar_interval_ns}, watchlist_{options.watchlist},
+    decoders_{options.book_depth != 0 ? kMessageDecoders<kBookFields> : kMessageDecoders<kVwapFields>} {
+        const size_t num_shards = std::max<size_t>(1, options.workers);
+        for (size_t i = 0; i < num_shards; ++i) {
+            rings_.push_back(std::make_unique<MessageRing>(
+                options.queue_capacity, options.wait_strategy, options.queue_batch));
+        }
+        live_ = reads_live(options);
+        follow_ = options.follow && file_path_ != "-";
+        feed_ = parse_feed_address(file_path_);
+        routed_ = num_shards > 1 || !watchlist_.empty() || options.checkpoint || live_;
+        if (num_decoders_ > 1) {
+            for (size_t k = 0; k < num_decoders_; ++k) {
+                decoder_metrics_.push_back(std::make_unique<DecodeMetrics>());
+            }
+        }
+    }
+
+    size_t num_shards() const {
+        return rings_.size();
+    }
+
+    /*
+        Before start_reading: start at input_offset (of the decompressed data) instead of the beginning,
+            the last message read before it had this timestamp.
+    */
+    void resume_from(const uint64_t input_offset, const uint64_t timestamp) {
+        resume_offset_ = input_offset;
+        input_offset_ = input_offset;
+        latest_timestamp_ = timestamp;
+    }
+
+    /* Resuming with a watchlist: the locates the skipped Stock Directory messages resolved */
+    void restore_watchlist(const SymbolDirectory& symbols) {
+        for (size_t locate = 0; locate < kMaxLocates; ++locate) {
+            if (symbols.contains(locate)) {
+                watchlist_.resolve(locate, symbols.get(locate));
+            }
+        }
+    }
+
     void start_reading() {
-        ifs_.open(file_path_);
-        if (!ifs_.is_open()) {
-            std::cerr << "Error opening file " << file_path_ << std::endl;
+        metrics_.time.begin();
+        if (live_) {
+            start_live_();
             return;
         }
-        reader_thread_ = std::thread(&MessageReader::read_from_stream, this);
+        const Compression compression = detect_compression(file_path_);
+        if (compression == Compression::zstd) {
+            std::cerr << "zstd compressed input is not supported, decompress " << file_path_ << " first" << std::endl;
+            failed_ = true;
+            finish_reading_();
+            return;
+        }
+        if (compression == Compression::gzip) {
+#ifdef PARSER_HAVE_ZLIB
+            reader_thread_ = std::thread(&MessageReader::read_compressed_, this);
+#else
+            std::cerr << "gzip input needs a build with zlib, decompress " << file_path_ << " first" << std::endl;
+            failed_ = true;
+            finish_reading_();
+#endif
+            return;
+        }
+
+        switch(read_mode_) {
+            case ReadMode::stream: {
+                ifs_.open(file_path_);
+                if (!ifs_.is_open()) {
+                    std::cerr << "Error opening file " << file_path_ << std::endl;
+                    failed_ = true;
+                    finish_reading_();
+                    return;
+                }
+                if (resume_offset_ != 0 && !ifs_.seekg(resume_offset_)) {
+                    std::cerr << "Error seeking to " << resume_offset_ << " in " << file_path_ << std::endl;
+                    failed_ = true;
+                    finish_reading_();
+                    return;
+                }
+                reader_thread_ = std::thread(&MessageReader::read_from_stream, this);
+                break;
+            }
+            case ReadMode::mmap: {
+                if (!mapped_file_.open(file_path_)) {
+                    std::cerr << "Error mapping file " << file_path_ << std::endl;
+                    failed_ = true;
+                    finish_reading_();
+                    return;
+                }
+                if (resume_offset_ > mapped_file_.size()) {
+                    std::cerr << "Checkpoint is past the end of " << file_path_ << std::endl;
+                    failed_ = true;
+                    finish_reading_();
+                    return;
+                }
+                reader_thread_ = std::thread(&MessageReader::read_from_mapped_file, this);
+                break;
+            }
+        }
     }
 
     void stop_reading() {
@@ -26,131 +174,744 @@ public:
         }
     }
 
+    /* The file could not be read (opened, mapped or decompressed), valid once stop_reading() returned */
+    bool failed() const {
+        return failed_;
+    }
+
     bool ifs_finished() const {
-        return finished_reading_;
+        return rings_[0]->closed();
     }
 
-    bool get_next_message(std::unique_ptr<BaseMessage>& msg) {
-        std::unique_lock<std::mutex> lock(mutex_);
-        cv_.wait(lock, [&]{ return !msg_queue_.empty() || finished_reading_; });
-        if (finished_reading_ && msg_queue_.empty()) {
-            return false;
-        }
-        msg = std::move(msg_queue_.front());
-        msg_queue_.pop();
-        return true;
+    /* 
+        Blocks until the reader has handed over a batch of messages for this shard.
+        Returns the batch size, 0 once everything has been read and consumed.
+    */
+    size_t wait_for_messages(const size_t shard = 0) {
+        return rings_[shard]->acquire();
+    }
+
+    Message& message_at(const size_t i, const size_t shard = 0) {
+        return rings_[shard]->at(i);
+    }
+
+    /* Gives the first n messages of the batch back to the reader */
+    void release_messages(const size_t n, const size_t shard = 0) {
+        rings_[shard]->release(n);
+    }
+
+    /* ---------------- Stats, readable from any thread ---------------- */
+
+    /* The reader thread's, it frames every message unless decoders do (then its own are all 0) */
+    const DecodeMetrics& metrics() const {
+        return metrics_;
+    }
+
+    /* One per thread of --decoders, empty without */
+    const std::vector<std::unique_ptr<DecodeMetrics>>& decoder_metrics() const {
+        return decoder_metrics_;
+    }
+
+    /* Messages dropped by the watchlist */
+    uint64_t filtered() const {
+        return filtered_.get();
+    }
+
+    /* Time spent decompressing gzip input, 0 for plain files */
+    const StageTime& inflate_time() const {
+        return inflate_time_;
+    }
+
+    const MessageRing& ring(const size_t shard) const {
+        return *rings_[shard];
+    }
+
+    /* Packets, gaps and duplicates of a feed, all 0 for a file */
+    const FeedMetrics& feed_metrics() const {
+        return feed_metrics_;
+    }
+
+    bool reads_feed() const {
+        return feed_.protocol != FeedProtocol::none;
     }
 
 private:
     std::string file_path_;
+    ReadMode read_mode_;
     std::ifstream ifs_;
-    std::queue<std::unique_ptr<BaseMessage>> msg_queue_;
-    int msg_count = 0;
+    MappedFile mapped_file_;
+    std::vector<std::unique_ptr<MessageRing>> rings_; // one per shard
+
+    // Parallel decoding of mmapped files
+    size_t num_decoders_;
+    size_t chunk_size_;
+    std::string chunk_index_path_;
+    size_t queue_capacity_;
+    size_t queue_batch_;
+    WaitStrategy wait_strategy_;
     std::thread reader_thread_;
-    std::mutex mutex_;
-    std::condition_variable cv_;
-    bool finished_reading_ = false;
+    bool failed_ = false;
+
+    // Live input
+    static constexpr size_t kLiveBufferSize = size_t(1) << 20;
+    static constexpr std::chrono::milliseconds kFollowPollInterval{1};
+    bool live_ = false;
+    bool follow_ = false;
+    int live_fd_ = -1;
+    bool end_of_messages_ = false;
+    uint64_t read_ns_ = 0; // when the bytes being framed were read, live input only
+
+    // Feeds
+    FeedAddress feed_;
+    FeedMetrics feed_metrics_;
+    SequenceTracker sequence_{feed_metrics_};
+    MoldUdpSocket mold_socket_;
+    std::string mold_session_; // the first packet's, packets of other sessions are dropped
+    SoupBinTcpClient soup_client_;
+
+    // Compressed input: decompressed chunks in flight between the decompression thread and the reader
+    static constexpr size_t kCompressedChunks = 8;
+    static constexpr size_t kCompressedChunkSize = size_t(1) << 20;
+    static constexpr size_t kStatsWindow = size_t(1) << 20;
 
+    // Sharded mode or with a watchlist: messages are decoded here first, then copied to their shard(s),
+    //  and the reader sends the snapshot boundaries
+    bool routed_ = false;
+    Message scratch_;
+    uint64_t latest_timestamp_ = 0;
+    uint64_t bar_interval_ns_;
+    // Input offsets, in order of the (decompressed) data: where reading started, where the next unframed byte is,
+    //  and where the message being handed over starts
+    uint64_t resume_offset_ = 0;
+    uint64_t input_offset_ = 0;
+    uint64_t message_offset_ = 0;
+
+    Watchlist watchlist_;
+
+    const MessageDecoderTable& decoders_; // the book also needs sides, cancels and deletes
+
+    DecodeMetrics metrics_;
+    std::vector<std::unique_ptr<DecodeMetrics>> decoder_metrics_;
+    Counter filtered_;
+    StageTime inflate_time_;
+
+    /* Each message is read whole into a buffer, so it can be looked at before it is decoded */
     void read_from_stream() {
-        while (!ifs_.eof()) {
+        ReaderOutput output{*this};
+        std::vector<char> buffer(size_t(1) << 16);
+        while (true) {
             // Read message length
-            uint16_t msg_len = read_big_endian<2>(ifs_);
+            char length_prefix[2];
+            if (!ifs_.read(length_prefix, 2)) {
+                if (ifs_.gcount() != 0) {
+                    std::cerr << "Truncated message at end of file " << file_path_ << std::endl;
+                }
+                break;
+            }
+            const uint16_t msg_len = read_big_endian<2>(length_prefix);
             if (msg_len == 0) {
+                // Stepped over like in decode_range_, so checkpoints resume at the same byte as with mmap
+                metrics_.bytes.add(2);
+                input_offset_ += 2;
                 continue;
             }
+            if (!ifs_.read(buffer.data(), msg_len)) {
+                std::cerr << "Truncated message at end of file " << file_path_ << std::endl;
+                break;
+            }
+            // First byte: message type
+            metrics_.bytes.add(2 + msg_len);
+            message_offset_ = input_offset_;
+            input_offset_ += 2 + msg_len;
+            decode_framed_(buffer[0], buffer.data() + 1, msg_len - 1, output, metrics_, true);
+        }
 
-            // Read first byte: message type
-            char msg_type;
-            ifs_.read(&msg_type, 1);
+        finish_reading_();
+    }
 
-            msg_count++;
-            // [DEBUG]
-            if (msg_count % 10'000'000 == 0) {
-                std::cout << "Read " << msg_count << " messages." << std::endl;
+    void start_live_() {
+        if (feed_.protocol == FeedProtocol::mold_udp64) {
+            if (!mold_socket_.open(feed_)) {
+                failed_ = true;
+                finish_reading_();
+                return;
             }
-            
-            std::unique_ptr<BaseMessage> new_msg;
-            switch(msg_type) {
-                case 'S': {
-                    // System Event
-                    new_msg = std::make_unique<SystemEventMessage>();
-                    break;
+            reader_thread_ = std::thread(&MessageReader::read_mold_, this);
+            return;
+        }
+        if (feed_.protocol == FeedProtocol::soup_bin_tcp) {
+            if (!soup_client_.connect(feed_, sequence_.next())) {
+                failed_ = true;
+                finish_reading_();
+                return;
+            }
+            reader_thread_ = std::thread(&MessageReader::read_soup_, this);
+            return;
+        }
+        if (file_path_ == "-") {
+            live_fd_ = STDIN_FILENO;
+        } else {
+            if (detect_compression(file_path_) != Compression::none) {
+                std::cerr << "--follow needs an uncompressed file, " << file_path_ << " is compressed" << std::endl;
+                failed_ = true;
+                finish_reading_();
+                return;
+            }
+            live_fd_ = ::open(file_path_.c_str(), O_RDONLY);
+            if (live_fd_ < 0 || ::lseek(live_fd_, resume_offset_, SEEK_SET) < 0) {
+                std::cerr << "Error opening file " << file_path_ << std::endl;
+                failed_ = true;
+                finish_reading_();
+                return;
+            }
+        }
+        reader_thread_ = std::thread(&MessageReader::read_live_, this);
+    }
+
+    /*
+        Reads whatever has been written so far, frames and decodes the complete messages in it and keeps
+            the message cut in two by the end of the read for the next one.
+        Everything decoded goes to the parsers right away (the rings are flushed after every read) instead of
+            once a batch fills up, and boundaries are stamped with the time their message was read.
+        --follow: at the end of the file, waits for more (polling every kFollowPollInterval) until the
+            End of Messages system event. stdin: until it is closed.
+        Either way, until live_stop_requested().
+    */
+    void read_live_() {
+        ReaderOutput output{*this};
+        std::vector<char> buffer(kLiveBufferSize);
+        size_t filled = 0; // starts with an unframed message
+        while (!end_of_messages_ && !live_stop_requested().load(std::memory_order_relaxed)) {
+            const ssize_t n = ::read(live_fd_, buffer.data() + filled, buffer.size() - filled);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
                 }
-                case 'R': {
-                    // Stock Directory
-                    new_msg = std::make_unique<StockDirectoryMessage>();
+                std::cerr << "Error reading " << file_path_ << ": " << std::strerror(errno) << std::endl;
+                failed_ = true;
+                break;
+            }
+            if (n == 0) {
+                if (!follow_) {
                     break;
                 }
-                case 'A': {
-                    // Add Order
-                    new_msg = std::make_unique<AddOrderMessage>();
-                    break;
+                std::this_thread::sleep_for(kFollowPollInterval);
+                continue;
+            }
+            read_ns_ = steady_ns();
+            filled += n;
+            const char* pos = buffer.data();
+            decode_range_(pos, buffer.data() + filled, output, metrics_, true);
+            filled -= pos - buffer.data();
+            std::memmove(buffer.data(), pos, filled);
+            for (auto& ring: rings_) {
+                ring->flush();
+            }
+        }
+        if (filled != 0 && !live_stop_requested().load(std::memory_order_relaxed)) {
+            std::cerr << "Truncated message at end of " << file_path_ << std::endl;
+        }
+        if (live_fd_ != STDIN_FILENO) {
+            ::close(live_fd_);
+        }
+        finish_reading_();
+    }
+
+    /*
+        MoldUDP64: every datagram that has come in since the last call at once (MoldUdpSocket::receive),
+            the messages in them decoded in place and handed to the parsers right away.
+        Messages already seen are skipped, missing ones counted (SequenceTracker).
+        Until the End of Session packet, the End of Messages system event or live_stop_requested().
+    */
+    void read_mold_() {
+        ReaderOutput output{*this};
+        while (!end_of_messages_ && !live_stop_requested().load(std::memory_order_relaxed)) {
+            const int received = mold_socket_.receive();
+            if (received < 0) {
+                std::cerr << "Error receiving from " << file_path_ << ": " << std::strerror(errno) << std::endl;
+                failed_ = true;
+                break;
+            }
+            if (received == 0) {
+                continue;
+            }
+            read_ns_ = steady_ns();
+            for (int i = 0; i < received && !end_of_messages_; ++i) {
+                unwrap_mold_packet_(mold_socket_.data(i), mold_socket_.size(i), output);
+            }
+            for (auto& ring: rings_) {
+                ring->flush();
+            }
+        }
+        mold_socket_.close();
+        finish_reading_();
+    }
+
+    template <typename Output>
+    void unwrap_mold_packet_(const char* packet, const size_t size, Output& output) {
+        feed_metrics_.packets.add();
+        if (size < kMoldHeaderSize) {
+            feed_metrics_.malformed.add();
+            return;
+        }
+        const MoldHeader header = read_mold_header(packet);
+        if (mold_session_.empty()) {
+            mold_session_.assign(header.session, kMoldSessionLength);
+        } else if (mold_session_.compare(0, kMoldSessionLength, header.session, kMoldSessionLength) != 0) {
+            feed_metrics_.malformed.add();
+            return;
+        }
+        if (header.count == kMoldEndOfSession) {
+            sequence_.accept(header.sequence, 0);
+            end_of_messages_ = true;
+            return;
+        }
+
+        const char* pos = packet + kMoldHeaderSize;
+        const char* const end = packet + size;
+        for (uint64_t skip = sequence_.accept(header.sequence, header.count); skip != 0 && end - pos >= 2; --skip) {
+            pos += 2 + read_big_endian<2>(pos);
+        }
+        if (pos > end) {
+            feed_metrics_.malformed.add();
+            return;
+        }
+        decode_range_(pos, end, output, metrics_, true);
+        if (pos != end) {
+            feed_metrics_.malformed.add();
+        }
+    }
+
+    /*
+        SoupBinTCP: like read_live_, whatever came is framed (Soup packets this time) and the complete ones
+            handled, the packet cut in two by the end of a read is kept for the next one.
+        Sequenced Data packets hold one ITCH message each, the rest are heartbeats and the End of Session.
+        Until the End of Session packet, the End of Messages system event, the server closing
+            the connection or live_stop_requested().
+    */
+    void read_soup_() {
+        ReaderOutput output{*this};
+        std::vector<char> buffer(kLiveBufferSize);
+        size_t filled = 0;
+        // Messages the server doesn't have any more are a gap at the start
+        sequence_.accept(soup_client_.accepted_sequence(), 0);
+        bool connected = true;
+        while (!end_of_messages_ && !live_stop_requested().load(std::memory_order_relaxed)) {
+            const ssize_t n = soup_client_.receive(buffer.data() + filled, buffer.size() - filled);
+            if (n < 0) {
+                std::cerr << "Connection to " << file_path_ << " closed before the end of the session" << std::endl;
+                connected = false;
+                break;
+            }
+            if (n == 0) {
+                continue;
+            }
+            read_ns_ = steady_ns();
+            filled += n;
+            const char* pos = buffer.data();
+            const char* const end = buffer.data() + filled;
+            while (end - pos >= 3 && !end_of_messages_) {
+                const uint16_t packet_len = read_big_endian<2>(pos);
+                if (packet_len == 0) {
+                    feed_metrics_.malformed.add();
+                    pos += 2;
+                    continue;
                 }
-                case 'F': {
-                    // Add Order with MPID Attribution
-                    new_msg = std::make_unique<AddOrderMPIDAttributionMessage>();
+                if (end - pos - 2 < packet_len) {
                     break;
                 }
-                case 'E': {
-                    // Order Executed
-                    new_msg = std::make_unique<OrderExecutedMessage>();
-                    break;
+                const char type = pos[2];
+                const char* payload = pos + 3;
+                pos += 2 + packet_len;
+                feed_metrics_.packets.add();
+                if (type == kSoupSequencedData && packet_len >= 2) {
+                    sequence_.accept(sequence_.next(), 1);
+                    metrics_.bytes.add(2 + packet_len);
+                    message_offset_ = input_offset_;
+                    input_offset_ += packet_len + 1;
+                    decode_framed_(payload[0], payload + 1, packet_len - 2, output, metrics_, true);
+                } else if (type == kSoupEndOfSession) {
+                    end_of_messages_ = true;
                 }
-                case 'C': {
-                    // Order Executed With Price
-                    new_msg = std::make_unique<OrderExecutedWithPriceMessage>();
+            }
+            filled = end - pos;
+            std::memmove(buffer.data(), pos, filled);
+            for (auto& ring: rings_) {
+                ring->flush();
+            }
+        }
+        if (connected) {
+            soup_client_.logout();
+        }
+        soup_client_.close();
+        finish_reading_();
+    }
+
+    /* Hands messages decoded by the reader thread itself to the parser(s) */
+    struct ReaderOutput {
+        MessageReader& reader;
+        Message& claim() {
+            return reader.next_slot_();
+        }
+        void commit() {
+            reader.publish_slot_();
+        }
+    };
+
+    void read_from_mapped_file() {
+        if (num_decoders_ > 1) {
+            read_chunked_();
+            return;
+        }
+        ReaderOutput output{*this};
+        const char* pos = mapped_file_.data() + resume_offset_;
+        const char* const end = mapped_file_.data() + mapped_file_.size();
+        // A window at a time, so the byte count in the stats keeps up while the file is read
+        while (true) {
+            const char* const window_end = size_t(end - pos) > kStatsWindow ? pos + kStatsWindow : end;
+            decode_range_(pos, window_end, output, metrics_, true);
+            if (window_end == end) {
+                break;
+            }
+        }
+        if (pos != end) {
+            std::cerr << "Truncated message at end of file " << file_path_ << std::endl;
+        }
+        finish_reading_();
+    }
+
+#ifdef PARSER_HAVE_ZLIB
+    /*
+        Decompression and decoding overlap: a decompression thread fills fixed-size chunks of a small ring,
+            this thread frames and decodes them in place as they come.
+        A message cut in two by a chunk boundary is put back together in carry, the rest is decoded
+            straight out of the chunk.
+    */
+    void read_compressed_() {
+        if (num_decoders_ > 1) {
+            std::cerr << "Compressed input is decoded by a single thread, ignoring --decoders" << std::endl;
+        }
+        GzipFile gzip_file;
+        if (!gzip_file.open(file_path_)) {
+            std::cerr << "Error opening file " << file_path_ << std::endl;
+            failed_ = true;
+            finish_reading_();
+            return;
+        }
+
+        // Slots (and their buffers) are reused, so nothing is allocated once every slot has been used once
+        SpscRing<std::vector<char>> chunks(kCompressedChunks, wait_strategy_, 1);
+        std::thread inflater([&] {
+            inflate_time_.begin();
+            // gzip can't seek, a resumed run inflates its way to the checkpoint
+            std::vector<char> skipped(resume_offset_ != 0 ? kCompressedChunkSize : 0);
+            for (uint64_t skip = resume_offset_; skip != 0; ) {
+                const size_t size = gzip_file.read(skipped.data(), std::min<uint64_t>(skip, skipped.size()));
+                if (size == 0) {
+                    std::cerr << "Checkpoint is past the end of " << file_path_ << std::endl;
+                    failed_ = true;
                     break;
                 }
-                case 'U': {
-                    // Order Replace
-                    new_msg = std::make_unique<OrderReplaceMessage>();
+                skip -= size;
+            }
+            while (true) {
+                std::vector<char>& chunk = chunks.claim();
+                chunk.resize(kCompressedChunkSize);
+                const size_t size = gzip_file.read(chunk.data(), chunk.size());
+                if (size == 0) {
                     break;
                 }
-                case 'P': {
-                    // Trade Message
-                    new_msg = std::make_unique<TradeMessage>();
-                    break;
+                chunk.resize(size);
+                chunks.commit();
+            }
+            if (gzip_file.failed()) {
+                failed_ = true;
+                std::cerr << "Error decompressing " << file_path_ << ", stopped at the last complete message" << std::endl;
+            }
+            inflate_time_.end();
+            chunks.close();
+        });
+
+        ReaderOutput output{*this};
+        std::vector<char> carry;
+        while (size_t available = chunks.acquire()) {
+            for (size_t i = 0; i < available; ++i) {
+                const std::vector<char>& chunk = chunks.at(i);
+                const char* pos = chunk.data();
+                const char* const end = pos + chunk.size();
+
+                // Finish the message the previous chunk ended in
+                while (!carry.empty() && pos != end) {
+                    const size_t needed = carry.size() < 2 ? 2 : 2 + read_big_endian<2>(carry.data());
+                    const size_t take = std::min<size_t>(needed - carry.size(), end - pos);
+                    carry.insert(carry.end(), pos, pos + take);
+                    pos += take;
+                    if (carry.size() >= 2 && carry.size() == 2 + read_big_endian<2>(carry.data())) {
+                        const char* carried = carry.data();
+                        decode_range_(carried, carried + carry.size(), output, metrics_, true);
+                        carry.clear();
+                    }
                 }
-                case 'Q': {
-                    // Cross Trade Message
-                    new_msg = std::make_unique<CrossTradeMessage>();
-                    break;
+
+                decode_range_(pos, end, output, metrics_, true);
+                carry.insert(carry.end(), pos, end);
+            }
+            chunks.release(available);
+        }
+        inflater.join();
+        if (!carry.empty()) {
+            std::cerr << "Truncated message at end of file " << file_path_ << std::endl;
+        }
+        finish_reading_();
+    }
+#endif // PARSER_HAVE_ZLIB
+
+    /*
+        Frames and decodes the messages in [pos, end) in place, nothing is copied.
+        Every message is stepped over by its length prefix, so fields we don't read cost nothing.
+        output is anything with Message& claim() and commit(), like a MessageRing.
+        metrics: the calling thread's counters, bytes are counted once at the end.
+        in_order: this is the reader thread going through the file in order, the watchlist is applied
+            (decoders of read_chunked_ leave that to the reader thread).
+        Stops before the first incomplete message, pos is left there (== end if everything was decoded).
+        Returns the number of messages handed to output.
+    */
+    template <typename Output>
+    uint64_t decode_range_(const char*& pos, const char* const end, Output& output, DecodeMetrics& metrics, const bool in_order) {
+        const char* const begin = pos;
+        uint64_t decoded = 0;
+        while (end - pos >= 2) {
+            uint16_t msg_len = read_big_endian<2>(pos);
+            if (end - pos - 2 < msg_len) {
+                break;
+            }
+            pos += 2;
+            if (msg_len == 0) {
+                continue;
+            }
+
+            const char msg_type = *pos;
+            const char* msg_body = pos + 1;
+            if (in_order) {
+                message_offset_ = input_offset_ + (pos - 2 - begin);
+            }
+            pos += msg_len;
+            decoded += decode_framed_(msg_type, msg_body, msg_len - 1, output, metrics, in_order);
+        }
+        metrics.bytes.add(pos - begin);
+        if (in_order) {
+            input_offset_ += pos - begin;
+        }
+        return decoded;
+    }
+
+    /*
+        One framed message, msg_body points right after the type and has body_size bytes.
+        A message too short for its type's Layout is skipped before anything is read from it, its fields
+            would be read from the next message (or past the end of the buffer for the last one).
+        Returns true if it was handed to output.
+    */
+    template <typename Output>
+    bool decode_framed_(const char msg_type, const char* msg_body, const size_t body_size, Output& output,
+        DecodeMetrics& metrics, const bool in_order) {
+        metrics.messages[static_cast<uint8_t>(msg_type)].add();
+        if (body_size < kMessageBodySizes[static_cast<uint8_t>(msg_type)]) {
+            metrics.malformed[static_cast<uint8_t>(msg_type)].add();
+            return false;
+        }
+        if (in_order) {
+            if (!watchlist_.empty() && !watched_(msg_type, msg_body)) {
+                filtered_.add();
+                advance_clock_(read_field<MessageHeader::Layout::timestamp>(msg_body));
+                return false;
+            }
+        }
+
+        Message& slot = output.claim();
+        if (!decode_message_(msg_type, msg_body, slot)) {
+            metrics.skipped[static_cast<uint8_t>(msg_type)].add();
+            return false; // skip message, slot is reused for the next one
+        }
+        output.commit();
+        return true;
+    }
+
+    /*
+        Watchlist check on the raw message, only the 2 byte locate is read (and the symbol of Stock Directory messages).
+        Types that aren't decoded anyway are let through, decode_message_ drops them.
+    */
+    bool watched_(const char msg_type, const char* msg_body) {
+        switch (msg_type) {
+            case 'S':
+                return true;
+            case 'R':
+                return watchlist_.resolve(read_field<MessageHeader::Layout::stock_locate>(msg_body),
+                    msg_body + StockDirectoryMessage::Layout::stock::offset);
+            case 'A': case 'F': case 'E': case 'C': case 'X': case 'D': case 'U': case 'P': case 'Q': case 'B':
+                return watchlist_.watches(read_field<MessageHeader::Layout::stock_locate>(msg_body));
+            default:
+                return true;
+        }
+    }
+
+    /* Same check on a decoded message */
+    bool watched_(const Message& msg) {
+        if (const auto* directory = std::get_if<StockDirectoryMessage>(&msg)) {
+            return watchlist_.resolve(directory->get_stock_locate(), directory->get_stock());
+        }
+        if (std::holds_alternative<SystemEventMessage>(msg)) {
+            return true;
+        }
+        return watchlist_.watches(get_stock_locate(msg));
+    }
+
+    /*
+        Parallel decoding of one file:
+        1. Framing pass (or a saved ChunkIndex) splits the file into chunks starting on message boundaries.
+        2. Decoder k decodes chunks k, k + K, k + 2K, ... into its own ring, and records
+            how many messages each chunk had once it's done with it.
+        3. This thread takes the chunks back in file order (chunk c from ring c % K)
+            and forwards the messages to the parser(s) as usual.
+        Each decoder can run ahead by one ring's worth of messages, which bounds memory.
+        The watchlist can only be applied in step 3, locates are resolved in file order,
+            so decoders still decode every message.
+    */
+    void read_chunked_() {
+        ChunkIndex index;
+        const bool loaded = !chunk_index_path_.empty() && index.load(chunk_index_path_, mapped_file_.size());
+        if (!loaded) {
+            index.build(mapped_file_.data(), mapped_file_.size());
+            if (!chunk_index_path_.empty() && !index.save(chunk_index_path_)) {
+                std::cerr << "Error saving chunk index " << chunk_index_path_ << std::endl;
+            }
+        }
+        const std::vector<uint64_t> chunks = index.chunks(chunk_size_);
+        const size_t num_chunks = chunks.size() - 1;
+
+        std::vector<std::unique_ptr<MessageRing>> decode_rings;
+        for (size_t k = 0; k < num_decoders_; ++k) {
+            decode_rings.push_back(std::make_unique<MessageRing>(
+                queue_capacity_, wait_strategy_, queue_batch_));
+        }
+        constexpr uint64_t kUnknownCount = ~uint64_t(0);
+        std::vector<std::atomic<uint64_t>> chunk_counts(num_chunks);
+        for (auto& count: chunk_counts) {
+            count.store(kUnknownCount, std::memory_order_relaxed);
+        }
+
+        std::vector<std::thread> decoders;
+        for (size_t k = 0; k < num_decoders_; ++k) {
+            decoders.emplace_back([&, k] {
+                MessageRing& ring = *decode_rings[k];
+                DecodeMetrics& metrics = *decoder_metrics_[k];
+                metrics.time.begin();
+                for (size_t c = k; c < num_chunks; c += num_decoders_) {
+                    const char* pos = mapped_file_.data() + chunks[c];
+                    const uint64_t count = decode_range_(pos, mapped_file_.data() + chunks[c + 1], ring, metrics, false);
+                    // Published before any message of the next chunk on this ring
+                    chunk_counts[c].store(count, std::memory_order_release);
+                    ring.flush();
                 }
-                case 'B': {
-                    // Broken Trade Message
-                    new_msg = std::make_unique<BrokenTradeMessage>();
+                metrics.time.end();
+                ring.close();
+            });
+        }
+
+        for (size_t c = 0; c < num_chunks; ++c) {
+            MessageRing& ring = *decode_rings[c % num_decoders_];
+            uint64_t forwarded = 0;
+            while (true) {
+                uint64_t count = chunk_counts[c].load(std::memory_order_acquire);
+                if (forwarded == count) {
                     break;
                 }
-                default: {
-                    // std::cout << "Skip message type: " << msg_type << ", len: " << msg_len << std::endl;
-                    ifs_.ignore(msg_len - 1);
-                    continue; // read and discard, skip message
-                    break;
+                size_t available = ring.acquire();
+                // Anything acquired past the end of chunk c belongs to chunk c + K
+                count = chunk_counts[c].load(std::memory_order_acquire);
+                if (count != kUnknownCount) {
+                    available = std::min<uint64_t>(available, count - forwarded);
                 }
-                /* 
-                    For the purpose of VWAP, not interested in order cancel and delete 
-                        since they don't modify price
-                    Also not checking if an order is still valid
-                        assuming data is correct 
-                        (trades that are erratic will be announced in trade break messages)
-                */
+                for (size_t i = 0; i < available; ++i) {
+                    const Message& msg = ring.at(i);
+                    if (!watchlist_.empty() && !watched_(msg)) {
+                        filtered_.add();
+                        advance_clock_(get_timestamp(msg));
+                        continue;
+                    }
+                    next_slot_() = msg;
+                    publish_slot_();
+                }
+                ring.release(available);
+                forwarded += available;
             }
-            new_msg->read_from_stream(ifs_);
-            {
-                std::lock_guard<std::mutex> lock(mutex_);
-                msg_queue_.push(std::move(new_msg));
+        }
+
+        for (auto& decoder: decoders) {
+            decoder.join();
+        }
+        finish_reading_();
+    }
+
+    /* Where the next message gets decoded into */
+    Message& next_slot_() {
+        if (!routed_) {
+            return rings_[0]->claim();
+        }
+        return scratch_;
+    }
+
+    /* The message decoded into next_slot_() is complete, hand it over */
+    void publish_slot_() {
+        if (!routed_) {
+            rings_[0]->commit();
+            return;
+        }
+
+        advance_clock_(get_timestamp(scratch_));
+        if (const auto* event = std::get_if<SystemEventMessage>(&scratch_)) {
+            if ((follow_ || reads_feed()) && event->get_event_code() == 'C') {
+                end_of_messages_ = true;
             }
-            cv_.notify_one();
-            
+            broadcast_(scratch_);
+            return;
+        }
+        MessageRing& ring = *rings_[get_stock_locate(scratch_) % rings_.size()];
+        ring.claim() = scratch_;
+        ring.commit();
+    }
+
+    /* Routed mode: tells every shard when the stream crosses a snapshot boundary */
+    void advance_clock_(const uint64_t timestamp) {
+        if (get_hour_by_timestamp(latest_timestamp_) < get_hour_by_timestamp(timestamp)
+            || (bar_interval_ns_ != 0 && latest_timestamp_ / bar_interval_ns_ < timestamp / bar_interval_ns_)) {
+            broadcast_(SnapshotBoundaryMessage(timestamp, message_offset_, read_ns_));
+        }
+        latest_timestamp_ = timestamp;
+    }
+
+    void broadcast_(const Message& msg) {
+        for (auto& ring: rings_) {
+            ring->claim() = msg;
+            ring->commit();
         }
+    }
 
-        // Finished reading
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            finished_reading_ = true;
+    void finish_reading_() {
+        metrics_.time.end();
+        for (auto& ring: rings_) {
+            ring->close();
         }
-        cv_.notify_one();
-    }    
+    }
+
+    /*
+        Decodes the message in place into slot, nothing is allocated.
+        source points right after the message type, into the mapped file or a buffer.
+        Returns false for message types we are not interested in.
+        One indirect call through the decoder table, which only decodes the fields VWAP and bars (or the book) use.
+    */
+    bool decode_message_(const char msg_type, const char* source, Message& slot) const {
+        return decoders_[static_cast<uint8_t>(msg_type)](source, slot);
+    }
 };
 
 #endif // MESSAGE_READER_H
\ No newline at end of file
@@ -1,75 +1,133 @@
 #ifndef MESSAGE_TYPES_H
 #define MESSAGE_TYPES_H
+#include <array>
 #include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <stddef.h>
-#include <unordered_map>
-#include <memory>
+#include <string>
+#include <utility>
+#include <variant>
 #include "trade_types.h"
 #include "system_data.h"
 #include "utils.h"
 
-static constexpr int PRICE_DIVIDER_4DIGITS = 10000;
+/*
+    A field of a message: offset in bytes from right after the Message Type field, and width in bytes.
+    Offsets are 1 less than the ones in the spec since the Message Type field is not counted.
+*/
+template <size_t Offset, size_t Width>
+struct Field {
+    static constexpr size_t offset = Offset;
+    static constexpr size_t width = Width;
+};
 
-static inline void get_price_4digits(float& price, std::istream& is) {
-    uint32_t price_buf = read_big_endian<4>(is);
-    price = float(price_buf) / PRICE_DIVIDER_4DIGITS;
+/* Where a field ends, a Layout's size is where its last field ends */
+template <typename F>
+inline constexpr size_t field_end = F::offset + F::width;
+
+/* Big endian integer fields */
+template <typename F>
+static inline uint64_t read_field(const char* body) {
+    return read_big_endian<F::width>(body + F::offset);
 }
 
-static inline void get_stock_8bytes(std::string& stock, std::istream& is) {
-    char stock_buf[8];
-    is.read(stock_buf, 8);
-    stock.assign(stock_buf, 8);
+static inline void get_stock_8bytes(char (&stock)[8], const char* buf) {
+    std::memcpy(stock, buf, 8);
 }
 
 /* We could actually ignore the side of orders for the purpose of VWAP but anyways */
-static inline void get_buy_sell_side(BuySellSide& side, std::istream& is) {
-    char buy_sell_buf;
-    is.read(&buy_sell_buf, 1);
-    if (buy_sell_buf == 'B') {
+static inline void get_buy_sell_side(BuySellSide& side, const char* buf) {
+    if (*buf == 'B') {
         side = kBuy;
-    } else if (buy_sell_buf == 'S') {
+    } else if (*buf == 'S') {
         side = kSell;
     } else {
         side = kUnknown;
     }
 }
 
-static inline void get_printable(bool& printable, std::istream& is) {
-    char printable_buf;
-    is.read(&printable_buf, 1);
-    printable = (printable_buf == 'Y');
-}
-
-static inline void skip_bytes(size_t n_bytes, std::istream& is) {
-    is.ignore(n_bytes);
+static inline void get_printable(bool& printable, const char* buf) {
+    printable = (*buf == 'Y');
 }
 
-// All message types skip Message Type field (1 byte)
+/*
+    Fields only some pipelines need, passed as the Fields template argument of decode().
+    They are not decoded at all unless asked for, everything else a message keeps is needed by every pipeline.
+*/
+enum DecodedField: uint32_t {
+    kFieldSide = 1 << 0, // side of added orders, kUnknown if not decoded
+    kFieldStock = 1 << 1, // symbol repeated in add order and trade messages (the locate says the same), left as is if not decoded
+    kFieldCancels = 1 << 2 // Order Cancel and Order Delete messages, skipped (not decoded at all) if not asked for
+};
+static constexpr uint32_t kVwapFields = 0; // VWAP and bars only need locate, price, shares and the references
+static constexpr uint32_t kBookFields = kFieldSide | kFieldCancels; // the order book (--book-depth) also needs these
+static constexpr uint32_t kAllFields = kFieldSide | kFieldStock | kFieldCancels;
+
+/*
+    Each message type describes where its fields are once, in its Layout (see Field),
+        and decode() reads them from there, from a pointer right after the Message Type field.
+        Layout::size is how much of the body that reads, a shorter message is malformed (see kMessageBodySizes).
+
+    Messages are plain values (no heap members, no vtable) held in the Message variant below,
+        so the reader can decode them straight into preallocated ring slots.
+    Each type has the same interface:
+        static constexpr char kType; // its Message Type byte
+        template <uint32_t Fields> void decode(const char* body);
+        void process(SystemData& sd);
+*/
 
-class BaseMessage {
+/* Fields every message starts with */
+class MessageHeader {
 public:
-    virtual void read_from_stream(std::istream& is) = 0;
-    virtual void process(SystemData& sd) = 0;
-    virtual ~BaseMessage() {}
-};
+    struct Layout {
+        using stock_locate = Field<0, 2>;
+        using tracking_number = Field<2, 2>; // not interested
+        using timestamp = Field<4, 6>;
+        static constexpr size_t size = field_end<timestamp>;
+    };
+
+    uint16_t get_stock_locate() const {
+        return stock_locate;
+    }
 
+    uint64_t get_timestamp() const {
+        return timestamp;
+    }
 
-class SystemEventMessage: public BaseMessage {
+protected:
     uint16_t stock_locate;
-    // ignore tracking number 2 bytes, not interested
     uint64_t timestamp; // 6 bytes
+
+    void decode_header_(const char* body) {
+        stock_locate = read_field<Layout::stock_locate>(body);
+        timestamp = read_field<Layout::timestamp>(body);
+    }
+};
+
+
+class SystemEventMessage: public MessageHeader {
     char event_code;
 
 public:
-    void read_from_stream(std::istream& is) override {
-        stock_locate = read_big_endian<2>(is);
-        skip_bytes(2, is); // skip tracking number
-        timestamp = read_big_endian<6>(is);
-        is.read(&event_code, 1);
+    static constexpr char kType = 'S';
+
+    struct Layout: MessageHeader::Layout {
+        using event_code = Field<10, 1>;
+        static constexpr size_t size = field_end<event_code>;
+    };
+
+    template <uint32_t Fields>
+    void decode(const char* body) {
+        decode_header_(body);
+        event_code = body[Layout::event_code::offset];
+    }
+
+    char get_event_code() const {
+        return event_code;
     }
 
-    void process(SystemData& sd) override {
+    void process(SystemData& sd) {
         sd.update_timestamp(timestamp);
 
         switch(event_code) {
@@ -84,130 +142,166 @@ public:
     }
 };
 
-class StockDirectoryMessage: public BaseMessage {
-    uint16_t stock_locate;
-    // ignore tracking number 2 bytes, not interested
-    uint64_t timestamp; // 6 bytes
-    std::string stock; // 8 bytes
+class StockDirectoryMessage: public MessageHeader {
+    char stock[8];
     // 20 bytes of uninteresting data
 
 public:
-    void read_from_stream(std::istream& is) override {
-        stock_locate = read_big_endian<2>(is);
-        skip_bytes(2, is); // skip tracking number
-        timestamp = read_big_endian<6>(is);
-        get_stock_8bytes(stock, is);
-        skip_bytes(20, is);
+    static constexpr char kType = 'R';
+
+    struct Layout: MessageHeader::Layout {
+        using stock = Field<10, 8>;
+        static constexpr size_t size = field_end<stock>;
+    };
+
+    /* The stock is always decoded, it's what the directory is for */
+    template <uint32_t Fields>
+    void decode(const char* body) {
+        decode_header_(body);
+        get_stock_8bytes(stock, body + Layout::stock::offset);
+    }
+
+    /* The raw 8 bytes, not null terminated */
+    const char* get_stock() const {
+        return stock;
     }
 
-    void process(SystemData& sd) override {
+    void process(SystemData& sd) {
         sd.update_timestamp(timestamp);
         sd.add_stock_record(stock_locate, stock);
     }
 
 };
 
-class AddOrderMessage: public BaseMessage {
-    uint16_t stock_locate;
-    // ignore tracking number 2 bytes, not interested
-    uint64_t timestamp; // 6 bytes
+class AddOrderMessage: public MessageHeader {
     uint64_t order_reference_number;
     BuySellSide side = kUnknown; // read as 'B' or 'S'
     uint32_t shares;
-    std::string stock;
-    float price; // read as 4 bytes unsigned int, last 4 digits are after decimal
+    char stock[8];
+    uint32_t price; // 4 bytes unsigned int, last 4 digits are after decimal
 
 public:
-
-    void read_from_stream(std::istream& is) override {
-        stock_locate = read_big_endian<2>(is);
-        skip_bytes(2, is); // skip tracking number
-        timestamp = read_big_endian<6>(is);
-        order_reference_number = read_big_endian<8>(is);
-        get_buy_sell_side(side, is);
-        shares = read_big_endian<4>(is);
-        get_stock_8bytes(stock, is);
-        get_price_4digits(price, is);
-
+    static constexpr char kType = 'A';
+
+    struct Layout: MessageHeader::Layout {
+        using order_reference_number = Field<10, 8>;
+        using side = Field<18, 1>;
+        using shares = Field<19, 4>;
+        using stock = Field<23, 8>;
+        using price = Field<31, 4>;
+        static constexpr size_t size = field_end<price>;
+    };
+
+    template <uint32_t Fields>
+    void decode(const char* body) {
+        decode_header_(body);
+        order_reference_number = read_field<Layout::order_reference_number>(body);
+        if constexpr ((Fields & kFieldSide) != 0) {
+            get_buy_sell_side(side, body + Layout::side::offset);
+        } else {
+            side = kUnknown;
+        }
+        shares = read_field<Layout::shares>(body);
+        if constexpr ((Fields & kFieldStock) != 0) {
+            get_stock_8bytes(stock, body + Layout::stock::offset);
+        }
+        price = read_field<Layout::price>(body);
     }
-    
-    void process(SystemData& sd) override {
+
+    void process(SystemData& sd) {
         sd.update_timestamp(timestamp);
         Order order{
-            .stock_locate = stock_locate, 
-            .side = side, 
-            .shares = shares, 
-            .price = price, 
+            .stock_locate = stock_locate,
+            .side = side,
+            .shares = shares,
+            .price = price,
             .order_reference_number = order_reference_number
             };
-        sd.add_order(std::move(order));
+        sd.add_order(order);
 
     }
 
 };
 
-class AddOrderMPIDAttributionMessage: public BaseMessage {
-    uint16_t stock_locate;
-    // ignore tracking number 2 bytes, not interested
-    uint64_t timestamp; // 6 bytes
+class AddOrderMPIDAttributionMessage: public MessageHeader {
     uint64_t order_reference_number;
     BuySellSide side = kUnknown; // read as 'B' or 'S'
     uint32_t shares;
-    std::string stock;
-    float price; // read as 4 bytes unsigned int, last 4 digits are after decimal
+    char stock[8];
+    uint32_t price; // 4 bytes unsigned int, last 4 digits are after decimal
     // attribution 4 bytes, not interested
-    
+
 
 public:
-    void read_from_stream(std::istream& is) override {
-        stock_locate = read_big_endian<2>(is);
-        skip_bytes(2, is); // skip tracking number
-        timestamp = read_big_endian<6>(is);
-        order_reference_number = read_big_endian<8>(is);
-        get_buy_sell_side(side, is);
-        shares = read_big_endian<4>(is);
-        get_stock_8bytes(stock, is);
-        get_price_4digits(price, is);
-        skip_bytes(4, is);
-    }
-    
-    void process(SystemData& sd) override {
+    static constexpr char kType = 'F';
+
+    /* Same as Add Order, plus the attribution at the end */
+    struct Layout: AddOrderMessage::Layout {
+        using attribution = Field<35, 4>;
+        static constexpr size_t size = field_end<attribution>;
+    };
+
+    template <uint32_t Fields>
+    void decode(const char* body) {
+        decode_header_(body);
+        order_reference_number = read_field<Layout::order_reference_number>(body);
+        if constexpr ((Fields & kFieldSide) != 0) {
+            get_buy_sell_side(side, body + Layout::side::offset);
+        } else {
+            side = kUnknown;
+        }
+        shares = read_field<Layout::shares>(body);
+        if constexpr ((Fields & kFieldStock) != 0) {
+            get_stock_8bytes(stock, body + Layout::stock::offset);
+        }
+        price = read_field<Layout::price>(body);
+    }
+
+    void process(SystemData& sd) {
         sd.update_timestamp(timestamp);
         Order order{
-            .stock_locate = stock_locate, 
-            .side = side, 
-            .shares = shares, 
-            .price = price, 
+            .stock_locate = stock_locate,
+            .side = side,
+            .shares = shares,
+            .price = price,
             .order_reference_number = order_reference_number
             };
-        sd.add_order(std::move(order));
+        sd.add_order(order);
     }
-    
+
 };
 
-class OrderExecutedMessage: public BaseMessage {
-    uint16_t stock_locate;
-    // ignore tracking number 2 bytes, not interested
-    uint64_t timestamp; // 6 bytes
+class OrderExecutedMessage: public MessageHeader {
     uint64_t order_reference_number;
     uint32_t executed_shares;
     uint64_t match_number;
 
 public:
-    void read_from_stream(std::istream& is) override {
-        stock_locate = read_big_endian<2>(is);
-        skip_bytes(2, is); // skip tracking number
-        timestamp = read_big_endian<6>(is);
-        order_reference_number = read_big_endian<8>(is);
-        executed_shares = read_big_endian<4>(is);
-        match_number = read_big_endian<8>(is);
+    static constexpr char kType = 'E';
+
+    struct Layout: MessageHeader::Layout {
+        using order_reference_number = Field<10, 8>;
+        using executed_shares = Field<18, 4>;
+        using match_number = Field<22, 8>;
+        static constexpr size_t size = field_end<match_number>;
+    };
+
+    template <uint32_t Fields>
+    void decode(const char* body) {
+        decode_header_(body);
+        order_reference_number = read_field<Layout::order_reference_number>(body);
+        executed_shares = read_field<Layout::executed_shares>(body);
+        match_number = read_field<Layout::match_number>(body);
     }
 
-    void process(SystemData& sd) override {
+    void process(SystemData& sd) {
         sd.update_timestamp(timestamp);
 
-        Order order; 
-        sd.get_order_by_reference_number(order_reference_number, order);
+        // An unknown order has no price to trade at, it's left out like any other unknown reference
+        Order order{};
+        if (!sd.execute_order(order_reference_number, executed_shares, order)) {
+            return;
+        }
         Trade trade{
             .stock_locate = stock_locate,
             .shares = executed_shares,
@@ -215,36 +309,43 @@ public:
             .match_number = match_number
         };
 
-        sd.add_trade(std::move(trade));
+        sd.add_trade(trade);
 
     }
-   
+
 };
 
-class OrderExecutedWithPriceMessage: public BaseMessage {
-    uint16_t stock_locate;
-    // ignore tracking number 2 bytes, not interested
-    uint64_t timestamp; // 6 bytes
+class OrderExecutedWithPriceMessage: public MessageHeader {
     uint64_t order_reference_number;
     uint32_t executed_shares;
     uint64_t match_number;
     bool printable; // read as Y or N
-    float execution_price; // read as 4 bytes unsigned int, last 4 digits are after decimal
-    
+    uint32_t execution_price; // 4 bytes unsigned int, last 4 digits are after decimal
+
 public:
-    void read_from_stream(std::istream& is) override {
-        stock_locate = read_big_endian<2>(is);
-        skip_bytes(2, is); // skip tracking number
-        timestamp = read_big_endian<6>(is);
-        order_reference_number = read_big_endian<8>(is);
-        executed_shares = read_big_endian<4>(is);
-        match_number = read_big_endian<8>(is);
-        get_printable(printable, is);
-        get_price_4digits(execution_price, is);
-    }
-
-   void process(SystemData& sd) override {
+    static constexpr char kType = 'C';
+
+    /* Same as Order Executed, plus printable and the price */
+    struct Layout: OrderExecutedMessage::Layout {
+        using printable = Field<30, 1>;
+        using execution_price = Field<31, 4>;
+        static constexpr size_t size = field_end<execution_price>;
+    };
+
+    template <uint32_t Fields>
+    void decode(const char* body) {
+        decode_header_(body);
+        order_reference_number = read_field<Layout::order_reference_number>(body);
+        executed_shares = read_field<Layout::executed_shares>(body);
+        match_number = read_field<Layout::match_number>(body);
+        get_printable(printable, body + Layout::printable::offset);
+        execution_price = read_field<Layout::execution_price>(body);
+    }
+
+   void process(SystemData& sd) {
         sd.update_timestamp(timestamp);
+        // Off the book at the order's price, printable or not
+        sd.reduce_order(order_reference_number, executed_shares);
 
         // Do not calculate into VWAP if printable is "N"
         if (!printable) {
@@ -258,42 +359,97 @@ public:
             .match_number = match_number
         };
 
-        sd.add_trade(std::move(trade));
-        
+        sd.add_trade(trade);
+
     }
 };
 
 
-/* 
-    For the purpose of VWAP, not interested in order cancel and delete 
-        since they don't modify price
+/*
+    For the purpose of VWAP, not interested in order cancel and delete
+        since they don't modify price, they're only decoded for the order book (kFieldCancels).
     Also not checking if an order is still valid
-        assuming data is correct 
+        assuming data is correct
         (trades that are erratic will be announced in trade break messages)
 */
 
-class OrderReplaceMessage: public BaseMessage {
-    uint16_t stock_locate;
-    // ignore tracking number 2 bytes, not interested
-    uint64_t timestamp;
+class OrderCancelMessage: public MessageHeader {
+    uint64_t order_reference_number;
+    uint32_t cancelled_shares;
+
+public:
+    static constexpr char kType = 'X';
+
+    struct Layout: MessageHeader::Layout {
+        using order_reference_number = Field<10, 8>;
+        using cancelled_shares = Field<18, 4>;
+        static constexpr size_t size = field_end<cancelled_shares>;
+    };
+
+    template <uint32_t Fields>
+    void decode(const char* body) {
+        decode_header_(body);
+        order_reference_number = read_field<Layout::order_reference_number>(body);
+        cancelled_shares = read_field<Layout::cancelled_shares>(body);
+    }
+
+    void process(SystemData& sd) {
+        sd.update_timestamp(timestamp);
+        sd.reduce_order(order_reference_number, cancelled_shares);
+    }
+};
+
+class OrderDeleteMessage: public MessageHeader {
+    uint64_t order_reference_number;
+
+public:
+    static constexpr char kType = 'D';
+
+    struct Layout: MessageHeader::Layout {
+        using order_reference_number = Field<10, 8>;
+        static constexpr size_t size = field_end<order_reference_number>;
+    };
+
+    template <uint32_t Fields>
+    void decode(const char* body) {
+        decode_header_(body);
+        order_reference_number = read_field<Layout::order_reference_number>(body);
+    }
+
+    void process(SystemData& sd) {
+        sd.update_timestamp(timestamp);
+        sd.delete_order(order_reference_number);
+    }
+};
+
+class OrderReplaceMessage: public MessageHeader {
     uint64_t original_order_reference_number;
     uint64_t new_order_reference_number;
     uint32_t shares;
-    float price; // read as 4 bytes unsigned int, last 4 digits are after decimal
-    
+    uint32_t price; // 4 bytes unsigned int, last 4 digits are after decimal
+
 
 public:
-    void read_from_stream(std::istream& is) override {
-        stock_locate = read_big_endian<2>(is);
-        skip_bytes(2, is); // skip tracking number
-        timestamp = read_big_endian<6>(is);
-        original_order_reference_number = read_big_endian<8>(is);
-        new_order_reference_number = read_big_endian<8>(is);
-        shares = read_big_endian<4>(is);
-        get_price_4digits(price, is);
+    static constexpr char kType = 'U';
+
+    struct Layout: MessageHeader::Layout {
+        using original_order_reference_number = Field<10, 8>;
+        using new_order_reference_number = Field<18, 8>;
+        using shares = Field<26, 4>;
+        using price = Field<30, 4>;
+        static constexpr size_t size = field_end<price>;
+    };
+
+    template <uint32_t Fields>
+    void decode(const char* body) {
+        decode_header_(body);
+        original_order_reference_number = read_field<Layout::original_order_reference_number>(body);
+        new_order_reference_number = read_field<Layout::new_order_reference_number>(body);
+        shares = read_field<Layout::shares>(body);
+        price = read_field<Layout::price>(body);
     }
 
-    void process(SystemData& sd) override {
+    void process(SystemData& sd) {
         sd.update_timestamp(timestamp);
 
         sd.replace_order(
@@ -302,30 +458,39 @@ public:
     }
 };
 
-class TradeMessage: public BaseMessage {
-    uint16_t stock_locate;
-    // ignore tracking number 2 bytes, not interested
-    uint64_t timestamp;
-    // Ignore order_reference_number 8 bytes, 
+class TradeMessage: public MessageHeader {
+    // Ignore order_reference_number 8 bytes,
     // and side 1 byte as they are deprecated
     uint32_t shares;
-    std::string stock;
-    float price; // read as 4 bytes unsigned int, last 4 digits are after decimal
+    char stock[8];
+    uint32_t price; // 4 bytes unsigned int, last 4 digits are after decimal
     uint64_t match_number;
 
 public:
-    void read_from_stream(std::istream& is) override {
-        stock_locate = read_big_endian<2>(is);
-        skip_bytes(2, is); // skip tracking number
-        timestamp = read_big_endian<6>(is);
-        skip_bytes(8 + 1, is); // skip order_reference_number and side, as they are deprecated
-        shares = read_big_endian<4>(is);
-        get_stock_8bytes(stock, is);
-        get_price_4digits(price, is);
-        match_number = read_big_endian<8>(is);
-    }
-
-    void process(SystemData& sd) override {
+    static constexpr char kType = 'P';
+
+    struct Layout: MessageHeader::Layout {
+        using order_reference_number = Field<10, 8>; // deprecated
+        using side = Field<18, 1>; // deprecated
+        using shares = Field<19, 4>;
+        using stock = Field<23, 8>;
+        using price = Field<31, 4>;
+        using match_number = Field<35, 8>;
+        static constexpr size_t size = field_end<match_number>;
+    };
+
+    template <uint32_t Fields>
+    void decode(const char* body) {
+        decode_header_(body);
+        shares = read_field<Layout::shares>(body);
+        if constexpr ((Fields & kFieldStock) != 0) {
+            get_stock_8bytes(stock, body + Layout::stock::offset);
+        }
+        price = read_field<Layout::price>(body);
+        match_number = read_field<Layout::match_number>(body);
+    }
+
+    void process(SystemData& sd) {
         sd.update_timestamp(timestamp);
 
         Trade trade{
@@ -335,34 +500,42 @@ public:
             .match_number = match_number
         };
 
-        sd.add_trade(std::move(trade));
+        sd.add_trade(trade);
     }
-   
+
 };
 
-class CrossTradeMessage: public BaseMessage {
-    uint16_t stock_locate;
-    // ignore tracking number 2 bytes, not interested
-    uint64_t timestamp;
+class CrossTradeMessage: public MessageHeader {
     uint64_t shares;
-    std::string stock;
-    float cross_price; // read as 4 bytes unsigned int, last 4 digits are after decimal
+    char stock[8];
+    uint32_t cross_price; // 4 bytes unsigned int, last 4 digits are after decimal
     uint64_t match_number;
     // Ignore cross type 1 byte - not interested.
-    
+
 public:
-    void read_from_stream(std::istream& is) override {
-        stock_locate = read_big_endian<2>(is);
-        skip_bytes(2, is); // skip tracking number
-        timestamp = read_big_endian<6>(is);
-        shares = read_big_endian<8>(is);
-        get_stock_8bytes(stock, is);
-        get_price_4digits(cross_price, is);
-        match_number = read_big_endian<8>(is);
-        skip_bytes(1, is); // skip cross type 1 byte.
-    }
-
-    void process(SystemData& sd) override {
+    static constexpr char kType = 'Q';
+
+    struct Layout: MessageHeader::Layout {
+        using shares = Field<10, 8>;
+        using stock = Field<18, 8>;
+        using cross_price = Field<26, 4>;
+        using match_number = Field<30, 8>;
+        using cross_type = Field<38, 1>; // not interested
+        static constexpr size_t size = field_end<cross_type>;
+    };
+
+    template <uint32_t Fields>
+    void decode(const char* body) {
+        decode_header_(body);
+        shares = read_field<Layout::shares>(body);
+        if constexpr ((Fields & kFieldStock) != 0) {
+            get_stock_8bytes(stock, body + Layout::stock::offset);
+        }
+        cross_price = read_field<Layout::cross_price>(body);
+        match_number = read_field<Layout::match_number>(body);
+    }
+
+    void process(SystemData& sd) {
         sd.update_timestamp(timestamp);
 
         Trade trade{
@@ -372,32 +545,156 @@ public:
             .match_number = match_number
         };
 
-        sd.add_trade(std::move(trade));
+        sd.add_trade(trade);
     }
 };
 
 
-class BrokenTradeMessage: public BaseMessage {
-    uint16_t stock_locate;
-    // ignore tracking number 2 bytes, not interested
-    uint64_t timestamp; // 6 bytes
+class BrokenTradeMessage: public MessageHeader {
     uint64_t match_number;
-    
+
 public:
-    void read_from_stream(std::istream& is) override {
-        stock_locate = read_big_endian<2>(is);
-        skip_bytes(2, is); // skip tracking number
-        timestamp = read_big_endian<6>(is);
-        match_number = read_big_endian<8>(is);
+    static constexpr char kType = 'B';
+
+    struct Layout: MessageHeader::Layout {
+        using match_number = Field<10, 8>;
+        static constexpr size_t size = field_end<match_number>;
+    };
+
+    template <uint32_t Fields>
+    void decode(const char* body) {
+        decode_header_(body);
+        match_number = read_field<Layout::match_number>(body);
     }
 
-    void process(SystemData& sd) override {
+    void process(SystemData& sd) {
         sd.update_timestamp(timestamp);
 
         sd.cancel_trade(match_number);
     }
-   
+
+};
+
+/*
+    Not an ITCH message: in sharded mode the reader broadcasts one to every shard
+        when the stream crosses a snapshot boundary, so all shards snapshot at the same point.
+    With a watchlist too, since the message that crosses the boundary may be one the reader dropped.
+*/
+class SnapshotBoundaryMessage: public MessageHeader {
+public:
+    static constexpr char kType = 0; // not an ITCH message, made up by the reader
+
+    SnapshotBoundaryMessage() = default;
+    SnapshotBoundaryMessage(const uint64_t boundary_timestamp, const uint64_t offset = 0, const uint64_t read_at_ns = 0) {
+        stock_locate = 0;
+        timestamp = boundary_timestamp;
+        input_offset = offset;
+        read_ns = read_at_ns;
+    }
+
+    void process(SystemData& sd) {
+        sd.snapshot_boundary(timestamp, input_offset, read_ns);
+    }
+
+    uint64_t input_offset; // where the message that crossed the boundary starts, for checkpoints
+    uint64_t read_ns; // steady_ns() when that message was read, live input only (0 otherwise)
 };
 
+using Message = std::variant<
+    SystemEventMessage,
+    StockDirectoryMessage,
+    AddOrderMessage,
+    AddOrderMPIDAttributionMessage,
+    OrderExecutedMessage,
+    OrderExecutedWithPriceMessage,
+    OrderCancelMessage,
+    OrderDeleteMessage,
+    OrderReplaceMessage,
+    TradeMessage,
+    CrossTradeMessage,
+    BrokenTradeMessage,
+    SnapshotBoundaryMessage
+>;
+
+static inline void process_message(Message& msg, SystemData& sd) {
+    std::visit([&sd](auto& m) { m.process(sd); }, msg);
+}
+
+static inline uint16_t get_stock_locate(const Message& msg) {
+    return std::visit([](const auto& m) { return m.get_stock_locate(); }, msg);
+}
+
+static inline uint64_t get_timestamp(const Message& msg) {
+    return std::visit([](const auto& m) { return m.get_timestamp(); }, msg);
+}
+
+template <size_t... I>
+constexpr std::array<char, sizeof...(I)> make_message_types_(std::index_sequence<I...>) {
+    return {std::variant_alternative_t<I, Message>::kType...};
+}
+
+/* kType of each alternative of Message, by msg.index() */
+inline constexpr std::array<char, std::variant_size_v<Message>> kMessageTypes =
+    make_message_types_(std::make_index_sequence<std::variant_size_v<Message>>{});
+
+template <size_t... I>
+constexpr std::array<uint16_t, 256> make_message_body_sizes_(std::index_sequence<I...>) {
+    std::array<uint16_t, 256> sizes{};
+    ((sizes[static_cast<uint8_t>(std::variant_alternative_t<I, Message>::kType)] =
+        std::variant_alternative_t<I, Message>::Layout::size), ...);
+    return sizes;
+}
+
+/* Layout::size of each message type we decode by Message Type byte, 0 for the others (never read) */
+inline constexpr std::array<uint16_t, 256> kMessageBodySizes =
+    make_message_body_sizes_(std::make_index_sequence<std::variant_size_v<Message>>{});
+
+/*
+    Decoders indexed by the Message Type byte, built at compile time for a set of optional Fields.
+    A decoder decodes the message body into slot, nothing is allocated,
+        and returns false for message types we are not interested in.
+*/
+using MessageDecoder = bool (*)(const char* body, Message& slot);
+using MessageDecoderTable = std::array<MessageDecoder, 256>;
+
+template <typename M, uint32_t Fields>
+static bool decode_message_as(const char* body, Message& slot) {
+    slot.emplace<M>().template decode<Fields>(body);
+    return true;
+}
+
+static inline bool skip_message(const char*, Message&) {
+    return false;
+}
+
+template <uint32_t Fields>
+constexpr MessageDecoderTable make_message_decoders() {
+    MessageDecoderTable decoders{};
+    for (MessageDecoder& decoder: decoders) {
+        decoder = &skip_message;
+    }
+    decoders['S'] = &decode_message_as<SystemEventMessage, Fields>;
+    decoders['R'] = &decode_message_as<StockDirectoryMessage, Fields>;
+    decoders['A'] = &decode_message_as<AddOrderMessage, Fields>;
+    decoders['F'] = &decode_message_as<AddOrderMPIDAttributionMessage, Fields>;
+    decoders['E'] = &decode_message_as<OrderExecutedMessage, Fields>;
+    decoders['C'] = &decode_message_as<OrderExecutedWithPriceMessage, Fields>;
+    decoders['U'] = &decode_message_as<OrderReplaceMessage, Fields>;
+    decoders['P'] = &decode_message_as<TradeMessage, Fields>;
+    decoders['Q'] = &decode_message_as<CrossTradeMessage, Fields>;
+    decoders['B'] = &decode_message_as<BrokenTradeMessage, Fields>;
+    /*
+        For the purpose of VWAP, not interested in order cancel and delete
+            since they don't modify price, the order book needs them
+    */
+    if constexpr ((Fields & kFieldCancels) != 0) {
+        decoders['X'] = &decode_message_as<OrderCancelMessage, Fields>;
+        decoders['D'] = &decode_message_as<OrderDeleteMessage, Fields>;
+    }
+    return decoders;
+}
+
+template <uint32_t Fields>
+inline constexpr MessageDecoderTable kMessageDecoders = make_message_decoders<Fields>();
 
-#endif // MESSAGE_TYPES_H
\ No newline at end of file
+#endif // MESSAGE_TYPES_H
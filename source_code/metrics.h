@@ -0,0 +1,198 @@
+#ifndef METRICS_H
+#define METRICS_H
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+    Runtime counters, cheap enough to leave on.
+    Everything here has a single writer, the thread it belongs to, which updates it with relaxed
+        loads and stores (plain moves, no locked instructions). Any thread can read it at any time,
+        which is how the stats file is written while the run is going.
+*/
+
+class Counter {
+public:
+    void add(const uint64_t n = 1) {
+        value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void set(const uint64_t value) {
+        value_.store(value, std::memory_order_relaxed);
+    }
+
+    void set_max(const uint64_t value) {
+        if (value > value_.load(std::memory_order_relaxed)) {
+            value_.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t get() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+/* One counter per Message Type byte */
+using TypeCounters = std::array<Counter, 256>;
+
+inline uint64_t steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Wall time of a thread's stage, from begin() to end(), or to now while it runs */
+class StageTime {
+public:
+    void begin() {
+        begin_ns_.set(steady_ns());
+    }
+
+    void end() {
+        end_ns_.set(steady_ns());
+    }
+
+    uint64_t elapsed_ns() const {
+        const uint64_t begin = begin_ns_.get();
+        if (begin == 0) {
+            return 0;
+        }
+        const uint64_t end = end_ns_.get();
+        return (end != 0 ? end : steady_ns()) - begin;
+    }
+
+private:
+    Counter begin_ns_;
+    Counter end_ns_;
+};
+
+/*
+    Timestamps for timing short things: the TSC on x86 (a few ns to read), the steady clock elsewhere.
+    ticks_per_ns() converts, it is measured against the steady clock since the first call.
+*/
+class CycleClock {
+public:
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return steady_ns();
+#endif
+    }
+
+    /* Call once at startup, so ticks_per_ns() has a long interval to measure over */
+    static void calibrate() {
+        origin_();
+    }
+
+    static double ticks_per_ns() {
+        const Origin& origin = origin_();
+        uint64_t ns = steady_ns() - origin.ns;
+        if (ns < 10'000'000) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            ns = steady_ns() - origin.ns;
+        }
+        return double(now() - origin.ticks) / double(ns);
+    }
+
+private:
+    struct Origin {
+        uint64_t ticks = now();
+        uint64_t ns = steady_ns();
+    };
+
+    static const Origin& origin_() {
+        static const Origin origin;
+        return origin;
+    }
+};
+
+/*
+    HDR-style histogram: log-linear buckets, exact below 32, then 16 buckets per power of two,
+        so a value is known to within 1/16 (6.25%). Values of 2^40 and more land in the last bucket.
+    Fixed size (592 buckets), recording is a bit scan and three counter updates.
+*/
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBits = 4;
+    static constexpr size_t kSubBuckets = size_t(1) << kSubBits;
+    static constexpr unsigned kMaxBits = 40;
+    static constexpr size_t kBuckets = (kMaxBits - kSubBits + 1) * kSubBuckets;
+
+    void record(const uint64_t value) {
+        buckets_[bucket_of(value)].add();
+        count_.add();
+        sum_.add(value);
+        max_.set_max(value);
+    }
+
+    uint64_t count() const {
+        return count_.get();
+    }
+
+    uint64_t sum() const {
+        return sum_.get();
+    }
+
+    uint64_t max() const {
+        return max_.get();
+    }
+
+    /* Smallest recorded value v such that a share q (0 to 1) of the values are <= v, rounded up to its bucket */
+    uint64_t quantile(const double q) const {
+        const uint64_t total = count();
+        if (total == 0) {
+            return 0;
+        }
+        const uint64_t rank = std::max<uint64_t>(1, uint64_t(q * double(total) + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += buckets_[i].get();
+            if (seen >= rank) {
+                return std::min(bucket_high(i), max());
+            }
+        }
+        return max();
+    }
+
+    static size_t bucket_of(const uint64_t value) {
+        if (value < 2 * kSubBuckets) {
+            return value;
+        }
+        const unsigned msb = 63 - __builtin_clzll(value);
+        if (msb >= kMaxBits) {
+            return kBuckets - 1;
+        }
+        const unsigned shift = msb - kSubBits;
+        return (shift + 1) * kSubBuckets + ((value >> shift) - kSubBuckets);
+    }
+
+    /* Largest value that lands in bucket i */
+    static uint64_t bucket_high(const size_t i) {
+        if (i < 2 * kSubBuckets) {
+            return i;
+        }
+        if (i == kBuckets - 1) {
+            return ~uint64_t(0);
+        }
+        const unsigned shift = i / kSubBuckets - 1;
+        return ((kSubBuckets + i % kSubBuckets + 1) << shift) - 1;
+    }
+
+private:
+    std::array<Counter, kBuckets> buckets_;
+    Counter count_;
+    Counter sum_;
+    Counter max_;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,471 @@
+#ifndef NETWORK_FEED_H
+#define NETWORK_FEED_H
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "metrics.h"
+#include "utils.h"
+
+/*
+    ITCH from the network instead of a file, the data file path is udp://<host>:<port> or tcp://<host>:<port>.
+    udp: MoldUDP64. Each datagram is a 20 byte header (session, sequence number of its first message,
+        message count) followed by the messages, each with the same 2 byte length prefix as in a file.
+        Datagrams can be lost, duplicated or come out of order, the sequence numbers tell (SequenceTracker).
+        <host> is the address to listen on: a multicast group is joined, 0.0.0.0 takes anything sent to the port.
+    tcp: SoupBinTCP. A stream of packets (2 byte length, 1 byte type, payload) from a server, after a login.
+        Sequenced Data packets ('S') carry one ITCH message each, numbered from the one the login was accepted at.
+    MessageReader reads them (read_mold_, read_soup_), tools/itch_replay.cpp sends them.
+*/
+enum class FeedProtocol {
+    none, // a file
+    mold_udp64,
+    soup_bin_tcp
+};
+
+struct FeedAddress {
+    FeedProtocol protocol = FeedProtocol::none;
+    std::string host;
+    uint16_t port = 0;
+};
+
+/* udp://<host>:<port> or tcp://<host>:<port>, protocol none for anything else */
+inline FeedAddress parse_feed_address(const std::string& path) {
+    FeedAddress address;
+    FeedProtocol protocol = FeedProtocol::none;
+    if (path.rfind("udp://", 0) == 0) {
+        protocol = FeedProtocol::mold_udp64;
+    } else if (path.rfind("tcp://", 0) == 0) {
+        protocol = FeedProtocol::soup_bin_tcp;
+    } else {
+        return address;
+    }
+    const std::string rest = path.substr(6);
+    const size_t colon = rest.rfind(':');
+    unsigned port = 0;
+    char extra = 0;
+    if (colon == std::string::npos || colon == 0
+        || std::sscanf(rest.c_str() + colon + 1, "%u%c", &port, &extra) != 1 || port == 0 || port > 65535) {
+        return address;
+    }
+    address.protocol = protocol;
+    address.host = rest.substr(0, colon);
+    address.port = static_cast<uint16_t>(port);
+    return address;
+}
+
+/* IPv4 address of host (a name or dotted numbers) and port. Returns false (after printing why) if there is none */
+inline bool resolve_feed_address(const FeedAddress& address, sockaddr_in& result) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    addrinfo* found = nullptr;
+    if (::getaddrinfo(address.host.c_str(), nullptr, &hints, &found) != 0 || found == nullptr) {
+        std::cerr << "Unknown host " << address.host << std::endl;
+        return false;
+    }
+    result = *reinterpret_cast<const sockaddr_in*>(found->ai_addr);
+    result.sin_port = htons(address.port);
+    ::freeaddrinfo(found);
+    return true;
+}
+
+/* ---------------- MoldUDP64 ---------------- */
+
+static constexpr size_t kMoldSessionLength = 10;
+static constexpr size_t kMoldHeaderSize = kMoldSessionLength + 8 + 2;
+static constexpr uint16_t kMoldEndOfSession = 0xFFFF; // message count of the packet that ends a session
+static constexpr size_t kMoldMaxPacketSize = 65507;   // largest UDP payload
+
+struct MoldHeader {
+    const char* session;
+    uint64_t sequence;
+    uint16_t count; // 0: heartbeat, kMoldEndOfSession: end of session
+};
+
+inline MoldHeader read_mold_header(const char* packet) {
+    return MoldHeader{packet, read_big_endian<8>(packet + kMoldSessionLength),
+        static_cast<uint16_t>(read_big_endian<2>(packet + kMoldSessionLength + 8))};
+}
+
+inline void write_mold_header(char* packet, const char* session, const uint64_t sequence, const uint16_t count) {
+    std::memcpy(packet, session, kMoldSessionLength);
+    write_big_endian<8>(packet + kMoldSessionLength, sequence);
+    write_big_endian<2>(packet + kMoldSessionLength + 8, count);
+}
+
+/* ---------------- SoupBinTCP ---------------- */
+
+static constexpr size_t kSoupUsernameLength = 6;
+static constexpr size_t kSoupPasswordLength = 10;
+static constexpr size_t kSoupSessionLength = 10;
+static constexpr size_t kSoupSequenceLength = 20; // ASCII, right aligned, padded with spaces
+static constexpr size_t kSoupLoginRequestSize = 1 + kSoupUsernameLength + kSoupPasswordLength + kSoupSessionLength + kSoupSequenceLength;
+static constexpr size_t kSoupLoginAcceptedSize = 1 + kSoupSessionLength + kSoupSequenceLength;
+static constexpr uint64_t kSoupHeartbeatIntervalNs = 1'000'000'000;
+static constexpr uint64_t kSoupLoginTimeoutNs = 5'000'000'000; // for the answer to the login, from the connect on
+
+// Packet types
+static constexpr char kSoupLoginRequest = 'L';
+static constexpr char kSoupLoginAccepted = 'A';
+static constexpr char kSoupLoginRejected = 'J';
+static constexpr char kSoupSequencedData = 'S';
+static constexpr char kSoupServerHeartbeat = 'H';
+static constexpr char kSoupClientHeartbeat = 'R';
+static constexpr char kSoupEndOfSession = 'Z';
+static constexpr char kSoupLogout = 'O';
+
+/* 2 byte length (of type and payload) and type, the payload goes right after */
+inline void write_soup_header(char* packet, const char type, const size_t payload_size) {
+    write_big_endian<2>(packet, 1 + payload_size);
+    packet[2] = type;
+}
+
+/* A Soup numeric field: right aligned, padded with spaces */
+inline void write_soup_number(char* field, const size_t length, const uint64_t value) {
+    char digits[32];
+    const int n = std::snprintf(digits, sizeof(digits), "%llu", static_cast<unsigned long long>(value));
+    std::memset(field, ' ', length);
+    std::memcpy(field + length - n, digits, n);
+}
+
+inline uint64_t read_soup_number(const char* field, const size_t length) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (field[i] >= '0' && field[i] <= '9') {
+            value = value * 10 + (field[i] - '0');
+        }
+    }
+    return value;
+}
+
+/* ---------------- Receiving ---------------- */
+
+/* What the network reader saw, for the summary and the stats file */
+struct FeedMetrics {
+    Counter packets;
+    Counter gaps;       // times messages were missing
+    Counter lost;       // messages missing, in all of them
+    Counter duplicates; // messages received again
+    Counter malformed;  // packets that were cut short or of another session
+};
+
+/*
+    Sequence numbers of a session, expected from 1.
+    accept() is told about each packet and says how many of its messages are old (already seen, to be skipped).
+    A packet starting past the next expected message is a gap: those messages are lost, there is no
+        retransmission here. They are counted, and the first few gaps printed.
+*/
+class SequenceTracker {
+public:
+    explicit SequenceTracker(FeedMetrics& metrics): metrics_{metrics} {}
+
+    /* A packet of count messages, the first one numbered sequence. Returns how many of them to skip */
+    uint64_t accept(const uint64_t sequence, const uint64_t count) {
+        if (sequence > next_) {
+            const uint64_t lost = sequence - next_;
+            metrics_.gaps.add();
+            metrics_.lost.add(lost);
+            if (metrics_.gaps.get() <= kReportedGaps) {
+                std::cerr << "Gap in the feed: messages " << next_ << " to " << sequence - 1 << " lost" << std::endl;
+                if (metrics_.gaps.get() == kReportedGaps) {
+                    std::cerr << "Further gaps are only counted" << std::endl;
+                }
+            }
+            next_ = sequence;
+        }
+        const uint64_t old = std::min(count, next_ - sequence);
+        metrics_.duplicates.add(old);
+        next_ = std::max(next_, sequence + count);
+        return old;
+    }
+
+    uint64_t next() const {
+        return next_;
+    }
+
+private:
+    static constexpr uint64_t kReportedGaps = 10;
+    FeedMetrics& metrics_;
+    uint64_t next_ = 1;
+};
+
+/*
+    Timeouts on the sockets below so the reader never blocks for long: it checks whether
+        it was asked to stop (Ctrl-C) at least this often.
+*/
+static constexpr uint64_t kFeedReceiveTimeoutUs = 100'000;
+
+inline void set_receive_timeout(const int fd) {
+    timeval timeout{};
+    timeout.tv_sec = kFeedReceiveTimeoutUs / 1'000'000;
+    timeout.tv_usec = kFeedReceiveTimeoutUs % 1'000'000;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+/*
+    MoldUDP64 datagrams, received kBatch at a time with recvmmsg: one system call takes everything that
+        has queued up (MSG_WAITFORONE: it returns as soon as there is one, it doesn't wait for more).
+    The socket buffer is asked to be kReceiveBuffer big, the kernel drops what doesn't fit
+        while the reader is busy, and that shows as gaps. Linux caps it at net.core.rmem_max.
+*/
+class MoldUdpSocket {
+public:
+    static constexpr size_t kBatch = 64;
+    static constexpr int kReceiveBuffer = 32 << 20;
+
+    MoldUdpSocket() = default;
+    MoldUdpSocket(const MoldUdpSocket&) = delete;
+    MoldUdpSocket& operator=(const MoldUdpSocket&) = delete;
+    ~MoldUdpSocket() {
+        close();
+    }
+
+    /* Returns false (after printing why) if the address can't be listened on */
+    bool open(const FeedAddress& address) {
+        sockaddr_in addr{};
+        if (!resolve_feed_address(address, addr)) {
+            return false;
+        }
+        fd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd_ < 0) {
+            std::cerr << "Error creating a UDP socket: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        const int on = 1;
+        ::setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        ::setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &kReceiveBuffer, sizeof(kReceiveBuffer));
+        set_receive_timeout(fd_);
+        if (::bind(fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+            std::cerr << "Error listening on " << address.host << ":" << address.port << ": " << std::strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+        if (IN_MULTICAST(ntohl(addr.sin_addr.s_addr))) {
+            ip_mreq group{};
+            group.imr_multiaddr = addr.sin_addr;
+            group.imr_interface.s_addr = htonl(INADDR_ANY);
+            if (::setsockopt(fd_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group)) != 0) {
+                std::cerr << "Error joining " << address.host << ": " << std::strerror(errno) << std::endl;
+                close();
+                return false;
+            }
+        }
+
+        buffers_.resize(kBatch * kMoldMaxPacketSize);
+        for (size_t i = 0; i < kBatch; ++i) {
+            iovecs_[i].iov_base = buffers_.data() + i * kMoldMaxPacketSize;
+            iovecs_[i].iov_len = kMoldMaxPacketSize;
+            headers_[i] = mmsghdr{};
+            headers_[i].msg_hdr.msg_iov = &iovecs_[i];
+            headers_[i].msg_hdr.msg_iovlen = 1;
+        }
+        return true;
+    }
+
+    void close() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    /* Waits (up to the receive timeout) for datagrams. Returns how many came, 0 on timeout, -1 on error */
+    int receive() {
+        const int n = ::recvmmsg(fd_, headers_, kBatch, MSG_WAITFORONE, nullptr);
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        }
+        return n;
+    }
+
+    /* Datagram i of those receive() returned */
+    const char* data(const size_t i) const {
+        return buffers_.data() + i * kMoldMaxPacketSize;
+    }
+
+    size_t size(const size_t i) const {
+        return headers_[i].msg_len;
+    }
+
+private:
+    int fd_ = -1;
+    std::vector<char> buffers_;
+    iovec iovecs_[kBatch];
+    mmsghdr headers_[kBatch];
+};
+
+/*
+    Client side of a SoupBinTCP session: connects, logs in (blank username and password, the session
+        the server is on) and then hands out the stream as it comes, see MessageReader::read_soup_.
+    Sends a heartbeat every second while it reads, servers log out clients that go quiet.
+*/
+class SoupBinTcpClient {
+public:
+    SoupBinTcpClient() = default;
+    SoupBinTcpClient(const SoupBinTcpClient&) = delete;
+    SoupBinTcpClient& operator=(const SoupBinTcpClient&) = delete;
+    ~SoupBinTcpClient() {
+        close();
+    }
+
+    /*
+        Connects and logs in, asking for the messages from sequence on.
+        Returns false (after printing why) if the server can't be reached or rejects the login.
+    */
+    bool connect(const FeedAddress& address, const uint64_t sequence) {
+        sockaddr_in addr{};
+        if (!resolve_feed_address(address, addr)) {
+            return false;
+        }
+        fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd_ < 0 || ::connect(fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+            std::cerr << "Error connecting to " << address.host << ":" << address.port << ": " << std::strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+        const int on = 1;
+        ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        // From here on no receive blocks for long, a server that never answers the login is given up on
+        set_receive_timeout(fd_);
+        const uint64_t deadline_ns = steady_ns() + kSoupLoginTimeoutNs;
+
+        char login[2 + kSoupLoginRequestSize];
+        std::memset(login, ' ', sizeof(login));
+        write_soup_header(login, kSoupLoginRequest, kSoupLoginRequestSize - 1);
+        write_soup_number(login + sizeof(login) - kSoupSequenceLength, kSoupSequenceLength, sequence);
+        if (!send_(login, sizeof(login))) {
+            std::cerr << "Error logging in to " << address.host << ":" << address.port << std::endl;
+            close();
+            return false;
+        }
+
+        // The answer, read a packet at a time so nothing after it is taken yet (it may come in the same segment)
+        std::vector<char> body;
+        while (true) {
+            char header[3];
+            body.clear();
+            bool received = receive_all_(header, 2, deadline_ns);
+            const uint16_t packet_len = received ? read_big_endian<2>(header) : 0;
+            if (received && packet_len == 0) {
+                // No type, no body: skipped, as in the session's data
+                continue;
+            }
+            if (received) {
+                body.resize(packet_len - 1);
+                received = receive_all_(header + 2, 1, deadline_ns) && receive_all_(body.data(), body.size(), deadline_ns);
+            }
+            if (!received) {
+                if (steady_ns() >= deadline_ns) {
+                    std::cerr << "No answer to the login from " << address.host << ":" << address.port << " in "
+                    << kSoupLoginTimeoutNs / 1'000'000'000 << " s" << std::endl;
+                } else {
+                    std::cerr << "Connection to " << address.host << ":" << address.port << " closed before the login was accepted" << std::endl;
+                }
+                close();
+                return false;
+            }
+            if (header[2] == kSoupLoginRejected) {
+                std::cerr << "Login to " << address.host << ":" << address.port << " rejected ("
+                << (body.empty() ? '?' : body[0]) << ")" << std::endl;
+                close();
+                return false;
+            }
+            if (header[2] == kSoupLoginAccepted && body.size() + 1 == kSoupLoginAcceptedSize) {
+                break;
+            }
+        }
+        accepted_sequence_ = read_soup_number(body.data() + kSoupSessionLength, kSoupSequenceLength);
+        last_sent_ns_ = steady_ns();
+        return true;
+    }
+
+    void close() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    /* The sequence number of the first message the server will send */
+    uint64_t accepted_sequence() const {
+        return accepted_sequence_;
+    }
+
+    /*
+        Whatever has come since the last call, up to size bytes (waiting up to the receive timeout).
+        Returns the bytes read, 0 on timeout, -1 once the connection is closed or broken.
+    */
+    ssize_t receive(char* buffer, const size_t size) {
+        heartbeat_();
+        const ssize_t n = ::recv(fd_, buffer, size, 0);
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        }
+        return n == 0 ? -1 : n;
+    }
+
+    /* Polite goodbye before closing */
+    void logout() {
+        char packet[3];
+        write_soup_header(packet, kSoupLogout, 0);
+        send_(packet, sizeof(packet));
+    }
+
+private:
+    int fd_ = -1;
+    uint64_t accepted_sequence_ = 0;
+    uint64_t last_sent_ns_ = 0;
+
+    void heartbeat_() {
+        const uint64_t now = steady_ns();
+        if (now - last_sent_ns_ >= kSoupHeartbeatIntervalNs) {
+            char packet[3];
+            write_soup_header(packet, kSoupClientHeartbeat, 0);
+            send_(packet, sizeof(packet));
+            last_sent_ns_ = now;
+        }
+    }
+
+    bool send_(const char* data, size_t size) {
+        while (size != 0) {
+            const ssize_t n = ::send(fd_, data, size, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    /* Exactly size bytes, false if the connection is closed first or they haven't all come by deadline_ns */
+    bool receive_all_(char* data, size_t size, const uint64_t deadline_ns) {
+        while (size != 0) {
+            const ssize_t n = ::recv(fd_, data, size, 0);
+            if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) && steady_ns() < deadline_ns) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+};
+
+#endif // NETWORK_FEED_H
@@ -0,0 +1,402 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+#include <cctype>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "network_feed.h"
+#include "order_store.h"
+#include "snapshot_writer.h"
+#include "spsc_ring.h"
+#include "symbol_directory.h"
+
+enum class ReadMode {
+    stream,
+    mmap
+};
+
+/* Everything that can be set on the command line, with defaults */
+struct Options {
+    std::string print_format_str = "csv";
+    SnapshotWriter::PrintFormat print_format = SnapshotWriter::PrintFormat::csv;
+    std::string data_file_path = "./data/01302019.NASDAQ_ITCH50";
+    std::string output_dir_path = "./output/vwap/";
+
+    ReadMode read_mode = ReadMode::mmap;
+
+    // reader -> parser ring
+    size_t queue_capacity = 1 << 16;
+    size_t queue_batch = 256;
+    WaitStrategy wait_strategy = WaitStrategy::futex;
+
+    // order store is presized for this many orders, it still grows past it if needed
+    size_t expected_orders = OrderStore::kDefaultExpectedOrders;
+
+    // processing threads, messages are sharded by stock locate when > 1
+    size_t workers = 1;
+
+    // decoding threads for mmapped files, the file is split into chunks of chunk_size bytes when > 1
+    size_t decoders = 1;
+    size_t chunk_size = size_t(16) << 20;
+    std::string chunk_index_path; // message boundary index, built and saved here if missing
+
+    // OHLCV + VWAP bars of this length, in nanoseconds, 0 = no bars
+    uint64_t bar_interval_ns = 0;
+
+    // price levels per side written to book.csv at every bar (or hour), 0 = no order book
+    size_t book_depth = 0;
+
+    // only these symbols are processed and written out, empty = all of them
+    std::vector<std::string> watchlist;
+
+    // live per-locate stats published in this POSIX shared memory segment, empty = none (see shared_stats.h)
+    std::string shm_name;
+
+    // runtime stats written here at exit, and every stats_interval_ns while running if not 0, empty = no stats file
+    std::string stats_path;
+    uint64_t stats_interval_ns = 0;
+    // with a stats file, every n-th message processed is timed
+    size_t latency_sample = 256;
+
+    // batch mode: every day in this directory or list file, into a subdirectory of output_dir_path each
+    std::string batch_path;
+    size_t jobs = 0;             // days run at the same time, 0 = as many as the cores allow
+    uint64_t memory_budget = 0;  // bytes the days running at the same time may use, 0 = available memory
+
+    // save the state to <output_dir_path>/checkpoint.bin at every hourly boundary, and/or start from it
+    bool checkpoint = false;
+    bool resume = false;
+
+    // keep reading as the data file grows, until its End of Messages event (data_file_path "-" = stdin, read until closed)
+    bool follow = false;
+};
+
+/* A feed instead of a file: data_file_path udp://<host>:<port> (MoldUDP64) or tcp://<host>:<port> (SoupBinTCP) */
+inline bool reads_network(const Options& options) {
+    return parse_feed_address(options.data_file_path).protocol != FeedProtocol::none;
+}
+
+/* Data that is still being written: read as it comes and written out as soon as possible */
+inline bool reads_live(const Options& options) {
+    return options.follow || options.data_file_path == "-" || reads_network(options);
+}
+
+inline void print_usage(const char* program) {
+    std::cout << "HINT: Usage: " << program << " [<'csv', 'log' or 'binary'> [<data_file_path, - for stdin, udp:// or tcp://<host>:<port>> [<output_dir_path>]]] [options]" << std::endl
+    << "   or: " << program << " [<'csv', 'log' or 'binary'> [<output_dir_path>]] --batch=<directory or list file> [options]" << std::endl
+    << "Options:" << std::endl
+    << "  --reader=<'mmap' or 'stream'>        how the data file is read (default: mmap)" << std::endl
+    << "  --queue-capacity=<n>                 max messages in flight between reader and parser (default: 65536)" << std::endl
+    << "  --queue-batch=<n>                    messages handed to the parser at a time (default: 256)" << std::endl
+    << "  --wait=<'spin', 'yield' or 'futex'>  how reader/parser wait on each other (default: futex)" << std::endl
+    << "  --expected-orders=<n>                presize the order store for n orders (default: 4194304)" << std::endl
+    << "  --workers=<n>                        processing threads, sharded by stock locate (default: 1)" << std::endl
+    << "  --decoders=<n>                       decode the (mmapped) file with n threads in parallel (default: 1)" << std::endl
+    << "  --chunk-size=<bytes>                 size of the chunks decoded in parallel (default: 16777216)" << std::endl
+    << "  --chunk-index=<path>                 load message boundaries from path, or build and save them there" << std::endl
+    << "  --bar-interval=<n><'s', 'm' or 'h'>  also write bars of this length to bars.csv, e.g. 1s, 1m, 5m (default: off)" << std::endl
+    << "  --book-depth=<n>                     keep an order book and write its n best levels (1-10) to book.csv every bar or hour" << std::endl
+    << "  --symbols=<symbol>[,<symbol>...]     only process these symbols (default: all)" << std::endl
+    << "  --watchlist=<path>                   only process the symbols listed in path, separated by spaces, commas or new lines" << std::endl
+    << "  --shm=<name>                         publish live VWAP, volume and notional per symbol in shared memory /dev/shm/<name>" << std::endl
+    << "  --stats=<path>                       write message counts, queue and latency stats to path at exit" << std::endl
+    << "  --stats-interval=<duration>          also append them to the stats file every interval while running, e.g. 10s" << std::endl
+    << "  --latency-sample=<n>                 time every n-th message processed for the stats file (default: 256)" << std::endl
+    << "  --batch=<directory or list file>     process every day in the directory, or listed in the file, into <output_dir_path>/<day>/" << std::endl
+    << "  --jobs=<n>                           days processed at the same time in batch mode (default: cores / threads per day)" << std::endl
+    << "  --memory-budget=<n><'M' or 'G'>      memory the days processed at the same time may use (default: available memory)" << std::endl
+    << "  --checkpoint                         save the state to <output_dir_path>/checkpoint.bin every hour of data" << std::endl
+    << "  --resume                             start from that checkpoint instead of the beginning of the file (implies --checkpoint)" << std::endl
+    << "  --follow                             keep reading as the data file grows, until its End of Messages event" << std::endl;
+}
+
+static inline bool parse_size_option_(const std::string& value, size_t& result) {
+    try {
+        size_t pos = 0;
+        const unsigned long long parsed = std::stoull(value, &pos);
+        if (pos != value.size() || parsed == 0) {
+            return false;
+        }
+        result = static_cast<size_t>(parsed);
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+/* <n>s, <n>m or <n>h, in nanoseconds */
+static inline bool parse_duration_option_(const std::string& value, uint64_t& result_ns) {
+    if (value.empty()) {
+        return false;
+    }
+    uint64_t unit_ns = 0;
+    switch (value.back()) {
+        case 's': unit_ns = 1'000'000'000ull; break;
+        case 'm': unit_ns = 60 * 1'000'000'000ull; break;
+        case 'h': unit_ns = 3600 * 1'000'000'000ull; break;
+        default: return false;
+    }
+    size_t count = 0;
+    if (!parse_size_option_(value.substr(0, value.size() - 1), count)) {
+        return false;
+    }
+    result_ns = count * unit_ns;
+    return true;
+}
+
+/* <n>M or <n>G, in bytes */
+static inline bool parse_memory_option_(const std::string& value, uint64_t& result) {
+    if (value.empty()) {
+        return false;
+    }
+    uint64_t unit = 0;
+    switch (value.back()) {
+        case 'M': unit = uint64_t(1) << 20; break;
+        case 'G': unit = uint64_t(1) << 30; break;
+        default: return false;
+    }
+    size_t count = 0;
+    if (!parse_size_option_(value.substr(0, value.size() - 1), count)) {
+        return false;
+    }
+    result = count * unit;
+    return true;
+}
+
+/* Symbols separated by whitespace or commas, each 1 to 8 characters */
+static inline bool parse_symbols_option_(const std::string& value, std::vector<std::string>& symbols) {
+    std::string symbol;
+    for (size_t i = 0; i <= value.size(); ++i) {
+        const char c = i < value.size() ? value[i] : ',';
+        if (c != ',' && !std::isspace(static_cast<unsigned char>(c))) {
+            symbol.push_back(c);
+            continue;
+        }
+        if (symbol.empty()) {
+            continue;
+        }
+        if (symbol.size() > kSymbolLength) {
+            std::cerr << "Symbol too long: " << symbol << std::endl;
+            return false;
+        }
+        symbols.push_back(symbol);
+        symbol.clear();
+    }
+    return true;
+}
+
+static inline bool parse_watchlist_option_(const std::string& path, std::vector<std::string>& symbols) {
+    std::ifstream ifs(path);
+    if (!ifs.is_open()) {
+        std::cerr << "Error opening watchlist " << path << std::endl;
+        return false;
+    }
+    const std::string content{std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()};
+    const size_t before = symbols.size();
+    if (!parse_symbols_option_(content, symbols)) {
+        return false;
+    }
+    if (symbols.size() == before) {
+        std::cerr << "No symbols in watchlist " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+    Positional arguments as before: [<'csv', 'log' or 'binary'> [<data_file_path> [<output_dir_path>]]],
+        with --batch: [<'csv', 'log' or 'binary'> [<output_dir_path>]]
+    Options look like --name=value and can go anywhere.
+    Returns false (after printing why) if the command line is not usable.
+*/
+inline bool parse_options(int argc, char** argv, Options& options) {
+    std::vector<std::string> positional_args;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            positional_args.push_back(arg);
+            continue;
+        }
+
+        const size_t eq = arg.find('=');
+        const std::string name = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+        const std::string value = (eq == std::string::npos) ? "" : arg.substr(eq + 1);
+        bool valid = true;
+        if (name == "reader") {
+            if (value == "mmap") {
+                options.read_mode = ReadMode::mmap;
+            } else if (value == "stream") {
+                options.read_mode = ReadMode::stream;
+            } else {
+                valid = false;
+            }
+        } else if (name == "queue-capacity") {
+            valid = parse_size_option_(value, options.queue_capacity);
+        } else if (name == "queue-batch") {
+            valid = parse_size_option_(value, options.queue_batch);
+        } else if (name == "expected-orders") {
+            valid = parse_size_option_(value, options.expected_orders);
+        } else if (name == "workers") {
+            valid = parse_size_option_(value, options.workers);
+        } else if (name == "decoders") {
+            valid = parse_size_option_(value, options.decoders);
+        } else if (name == "chunk-size") {
+            valid = parse_size_option_(value, options.chunk_size);
+        } else if (name == "chunk-index") {
+            options.chunk_index_path = value;
+            valid = !value.empty();
+        } else if (name == "bar-interval") {
+            valid = parse_duration_option_(value, options.bar_interval_ns);
+        } else if (name == "book-depth") {
+            valid = parse_size_option_(value, options.book_depth)
+                && options.book_depth >= 1 && options.book_depth <= kMaxBookDepth;
+        } else if (name == "symbols") {
+            const size_t before = options.watchlist.size();
+            valid = parse_symbols_option_(value, options.watchlist) && options.watchlist.size() > before;
+        } else if (name == "watchlist") {
+            valid = parse_watchlist_option_(value, options.watchlist);
+        } else if (name == "shm") {
+            options.shm_name = value;
+            valid = !value.empty() && value.find('/', 1) == std::string::npos;
+        } else if (name == "stats") {
+            options.stats_path = value;
+            valid = !value.empty();
+        } else if (name == "stats-interval") {
+            valid = parse_duration_option_(value, options.stats_interval_ns);
+        } else if (name == "latency-sample") {
+            valid = parse_size_option_(value, options.latency_sample);
+        } else if (name == "batch") {
+            options.batch_path = value;
+            valid = !value.empty();
+        } else if (name == "jobs") {
+            valid = parse_size_option_(value, options.jobs);
+        } else if (name == "memory-budget") {
+            valid = parse_memory_option_(value, options.memory_budget);
+        } else if (name == "checkpoint") {
+            options.checkpoint = true;
+            valid = value.empty();
+        } else if (name == "resume") {
+            options.resume = true;
+            options.checkpoint = true;
+            valid = value.empty();
+        } else if (name == "follow") {
+            options.follow = true;
+            valid = value.empty();
+        } else if (name == "wait") {
+            if (value == "spin") {
+                options.wait_strategy = WaitStrategy::spin;
+            } else if (value == "yield") {
+                options.wait_strategy = WaitStrategy::yield;
+            } else if (value == "futex") {
+                options.wait_strategy = WaitStrategy::futex;
+            } else {
+                valid = false;
+            }
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            print_usage(argv[0]);
+            return false;
+        }
+        if (!valid) {
+            std::cerr << "Invalid value for option " << arg << std::endl;
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+
+    if (options.decoders > 1 && options.read_mode != ReadMode::mmap) {
+        std::cerr << "--decoders needs --reader=mmap" << std::endl;
+        return false;
+    }
+
+    if (options.stats_interval_ns != 0 && options.stats_path.empty()) {
+        std::cerr << "--stats-interval needs --stats" << std::endl;
+        return false;
+    }
+
+    if (options.checkpoint && options.decoders > 1) {
+        std::cerr << "--checkpoint and --resume need the file read in order, they can't be used with --decoders" << std::endl;
+        return false;
+    }
+
+    if (options.follow && !options.batch_path.empty()) {
+        std::cerr << "--follow is for a single file, it can't be used with --batch" << std::endl;
+        return false;
+    }
+
+    // Each day writes its own stats file in its subdirectory, a path (absolute or not) would have them all share one
+    if (!options.batch_path.empty() && !options.stats_path.empty()
+        && std::filesystem::path(options.stats_path).has_parent_path()) {
+        std::cerr << "With --batch, --stats takes a file name, written in each day's subdirectory, not a path" << std::endl;
+        return false;
+    }
+
+    if (!options.batch_path.empty() && !options.shm_name.empty()) {
+        std::cerr << "--shm is for a single day, it can't be used with --batch" << std::endl;
+        return false;
+    }
+
+    if (!options.batch_path.empty() && !options.chunk_index_path.empty()) {
+        std::cerr << "--chunk-index is for a single file, it can't be used with --batch" << std::endl;
+        return false;
+    }
+
+    if (options.batch_path.empty() ? positional_args.size() < 3 : positional_args.size() < 2) {
+        print_usage(argv[0]);
+    }
+
+    if (positional_args.size() > 0) {
+        options.print_format_str = positional_args[0];
+    }
+    if (options.print_format_str == "csv") {
+        options.print_format = SnapshotWriter::PrintFormat::csv;
+    } else if (options.print_format_str == "log") {
+        options.print_format = SnapshotWriter::PrintFormat::log;
+    } else if (options.print_format_str == "binary") {
+        options.print_format = SnapshotWriter::PrintFormat::binary;
+    } else {
+        std::cerr << "format must be 'csv', 'log' or 'binary'" << std::endl;
+        print_usage(argv[0]);
+        return false;
+    }
+    if (!options.batch_path.empty()) {
+        // The data files come from --batch: [<format> [<output_dir_path>]]
+        if (positional_args.size() > 2) {
+            std::cerr << "With --batch, the only positional arguments are the format and the output directory" << std::endl;
+            return false;
+        }
+        if (positional_args.size() > 1) {
+            options.output_dir_path = positional_args[1];
+        }
+        return true;
+    }
+    if (positional_args.size() > 1) {
+        options.data_file_path = positional_args[1];
+    }
+    if (positional_args.size() > 2) {
+        options.output_dir_path = positional_args[2];
+    }
+    if (reads_live(options) && options.decoders > 1) {
+        std::cerr << "Live input (--follow or stdin) is decoded as it comes, it can't be used with --decoders" << std::endl;
+        return false;
+    }
+    if ((options.data_file_path == "-" || reads_network(options)) && options.checkpoint) {
+        std::cerr << "stdin or a feed can't be resumed from a checkpoint, --checkpoint and --resume need a data file" << std::endl;
+        return false;
+    }
+    if (reads_network(options) && options.follow) {
+        std::cerr << "--follow is for a data file, a feed is read until its end of session anyway" << std::endl;
+        return false;
+    }
+    if (options.data_file_path.find("://") != std::string::npos && !reads_network(options)) {
+        std::cerr << "A feed is udp://<host>:<port> (MoldUDP64) or tcp://<host>:<port> (SoupBinTCP), not " << options.data_file_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif // OPTIONS_H
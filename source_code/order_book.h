@@ -0,0 +1,283 @@
+#ifndef ORDER_BOOK_H
+#define ORDER_BOOK_H
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "state_image.h"
+#include "symbol_directory.h"
+#include "trade_types.h"
+
+/* Total resting shares and number of orders at one price */
+struct BookLevel {
+    uint32_t price; // 1/10000 ticks
+    uint32_t orders;
+    uint64_t shares;
+};
+
+static constexpr size_t kMaxBookDepth = 10;
+
+/* One symbol's top of the book, best level first, for the writer */
+struct BookRow {
+    uint16_t stock_locate;
+    SymbolDirectory::Symbol symbol;
+    uint8_t bid_levels;
+    uint8_t ask_levels;
+    std::array<BookLevel, kMaxBookDepth> bids;
+    std::array<BookLevel, kMaxBookDepth> asks;
+};
+
+/*
+    Price levels of every locate, built from the orders' adds, executions, cancels, deletes and replaces
+        (SystemData keeps the orders themselves in the OrderStore and tells the book what changed).
+    Each side of a locate keeps its kMaxBookDepth best levels in a small array inside the book, best first,
+        and the levels behind them in a sorted vector, best at the back: almost every update is at or near
+        the touch, so it's found by a short scan of the array, without following a pointer to the vector.
+        A level that leaves the array is replaced by the vector's best, a level pushed out of it goes there.
+    Books are allocated as their locate is first seen, the locate's slot is looked up in a flat index.
+    A locate whose shown levels changed is marked in a bitmap, take_depth only visits those.
+*/
+class OrderBook {
+public:
+    /* depth: levels per side shown by take_depth, up to kMaxBookDepth. 0 = no book, nothing is allocated */
+    explicit OrderBook(const size_t depth = 0)
+    : depth_{std::min(depth, kMaxBookDepth)} {
+        if (enabled()) {
+            slots_.resize(kMaxLocates, kNoSlot);
+            touched_.resize(kMaxLocates / 64);
+        }
+    }
+
+    bool enabled() const {
+        return depth_ != 0;
+    }
+
+    size_t depth() const {
+        return depth_;
+    }
+
+    /* An order of shares at price, side kBuy or kSell (others aren't booked) */
+    void add(const uint16_t locate, const BuySellSide side, const uint32_t price, const uint32_t shares) {
+        if (side == kUnknown) {
+            return;
+        }
+        Side& book_side = book_(locate).sides[side];
+        size_t i = 0;
+        while (i < book_side.top_size && better_(side, book_side.top[i].price, price)) {
+            ++i;
+        }
+        if (i < book_side.top_size && book_side.top[i].price == price) {
+            book_side.top[i].shares += shares;
+            book_side.top[i].orders++;
+        } else if (i < kMaxBookDepth) {
+            if (book_side.top_size == kMaxBookDepth) {
+                // The worst of the array is now better than anything in the vector
+                book_side.deep.push_back(book_side.top[kMaxBookDepth - 1]);
+                book_side.top_size--;
+            }
+            std::copy_backward(book_side.top.begin() + i, book_side.top.begin() + book_side.top_size,
+                book_side.top.begin() + book_side.top_size + 1);
+            book_side.top[i] = BookLevel{price, 1, shares};
+            book_side.top_size++;
+        } else {
+            std::vector<BookLevel>& deep = book_side.deep;
+            const size_t pos = find_deep_(deep, side, price);
+            if (pos < deep.size() && deep[pos].price == price) {
+                deep[pos].shares += shares;
+                deep[pos].orders++;
+            } else {
+                deep.insert(deep.begin() + pos, BookLevel{price, 1, shares});
+            }
+        }
+        if (i < depth_) {
+            touch_(locate);
+        }
+    }
+
+    /* shares come off an order at price, which leaves the book if order_gone */
+    void remove(const uint16_t locate, const BuySellSide side, const uint32_t price, const uint32_t shares, const bool order_gone) {
+        if (side == kUnknown || slots_[locate] == kNoSlot) {
+            return;
+        }
+        Side& book_side = books_[slots_[locate]].sides[side];
+        size_t i = 0;
+        while (i < book_side.top_size && better_(side, book_side.top[i].price, price)) {
+            ++i;
+        }
+        if (i < book_side.top_size) {
+            BookLevel& level = book_side.top[i];
+            if (level.price != price) {
+                return;
+            }
+            if (i < depth_) {
+                touch_(locate);
+            }
+            if (take_off_(level, shares, order_gone)) {
+                std::copy(book_side.top.begin() + i + 1, book_side.top.begin() + book_side.top_size, book_side.top.begin() + i);
+                book_side.top_size--;
+                if (!book_side.deep.empty()) {
+                    book_side.top[book_side.top_size++] = book_side.deep.back();
+                    book_side.deep.pop_back();
+                }
+            }
+            return;
+        }
+        std::vector<BookLevel>& deep = book_side.deep;
+        const size_t pos = find_deep_(deep, side, price);
+        if (pos < deep.size() && deep[pos].price == price && take_off_(deep[pos], shares, order_gone)) {
+            deep.erase(deep.begin() + pos);
+        }
+    }
+
+    /* Top depth() levels of every locate whose shown levels changed since the last call, into rows (in locate order) */
+    void take_depth(const SymbolDirectory& symbols, std::vector<BookRow>& rows) {
+        for (size_t w = 0; w < max_touched_word_; ++w) {
+            uint64_t word = touched_[w];
+            while (word) {
+                const size_t locate = w * 64 + __builtin_ctzll(word);
+                word &= word - 1;
+                if (!symbols.contains(locate)) {
+                    continue;
+                }
+                const Book& book = books_[slots_[locate]];
+                BookRow& row = rows.emplace_back();
+                row.stock_locate = static_cast<uint16_t>(locate);
+                std::copy_n(symbols.get(locate), kSymbolLength, row.symbol.begin());
+                row.bid_levels = static_cast<uint8_t>(std::min<size_t>(depth_, book.sides[kBuy].top_size));
+                row.ask_levels = static_cast<uint8_t>(std::min<size_t>(depth_, book.sides[kSell].top_size));
+                std::copy_n(book.sides[kBuy].top.begin(), row.bid_levels, row.bids.begin());
+                std::copy_n(book.sides[kSell].top.begin(), row.ask_levels, row.asks.begin());
+            }
+            touched_[w] = 0;
+        }
+        max_touched_word_ = 0;
+    }
+
+    size_t memory_usage() const {
+        size_t bytes = books_.capacity() * sizeof(Book) + locates_.capacity() * sizeof(uint16_t)
+            + slots_.capacity() * sizeof(uint32_t)
+            + touched_.capacity() * sizeof(uint64_t);
+        for (const Book& book: books_) {
+            bytes += (book.sides[kBuy].deep.capacity() + book.sides[kSell].deep.capacity()) * sizeof(BookLevel);
+        }
+        return bytes;
+    }
+
+    /* Number of price levels on both sides of every locate */
+    size_t levels() const {
+        size_t count = 0;
+        for (const Book& book: books_) {
+            for (const Side& book_side: book.sides) {
+                count += book_side.top_size + book_side.deep.size();
+            }
+        }
+        return count;
+    }
+
+    /* The levels of every locate seen so far, and the locates not written out yet */
+    void save(StateWriter& out) const {
+        if (!enabled()) {
+            return;
+        }
+        out.put(books_.size());
+        for (size_t slot = 0; slot < books_.size(); ++slot) {
+            out.put(locates_[slot]);
+            for (const Side& book_side: books_[slot].sides) {
+                out.put(book_side.top_size);
+                out.put_array(book_side.top.data(), book_side.top_size);
+                out.put(book_side.deep.size());
+                out.put_array(book_side.deep.data(), book_side.deep.size());
+            }
+        }
+        out.put(max_touched_word_);
+        out.put_array(touched_.data(), max_touched_word_);
+    }
+
+    /* Into an empty book of the same depth */
+    bool load(StateReader& in) {
+        if (!enabled()) {
+            return true;
+        }
+        size_t count = 0;
+        if (!in.get(count) || count > kMaxLocates) {
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            uint16_t locate = 0;
+            if (!in.get(locate) || slots_[locate] != kNoSlot) {
+                return false;
+            }
+            for (Side& book_side: book_(locate).sides) {
+                size_t deep_size = 0;
+                if (!in.get(book_side.top_size) || book_side.top_size > kMaxBookDepth
+                    || !in.get_array(book_side.top.data(), book_side.top_size)
+                    || !in.get(deep_size) || deep_size > kMaxDeepLevels) {
+                    return false;
+                }
+                book_side.deep.resize(deep_size);
+                if (!in.get_array(book_side.deep.data(), deep_size)) {
+                    return false;
+                }
+            }
+        }
+        return in.get(max_touched_word_) && max_touched_word_ <= touched_.size()
+            && in.get_array(touched_.data(), max_touched_word_);
+    }
+
+private:
+    static constexpr uint32_t kNoSlot = ~uint32_t(0);
+    static constexpr size_t kMaxDeepLevels = size_t(1) << 24; // sanity check of loaded images
+
+    /* Three cache lines, an update near the touch only reads the first one or two */
+    struct alignas(64) Side {
+        uint32_t top_size = 0;
+        std::array<BookLevel, kMaxBookDepth> top; // best first
+        std::vector<BookLevel> deep;              // worse than all of top, worst first
+    };
+
+    struct Book {
+        std::array<Side, 2> sides; // [kBuy], [kSell]
+    };
+
+    size_t depth_;
+    std::vector<Book> books_;       // in the order their locates were first seen
+    std::vector<uint16_t> locates_; // of books_
+    std::vector<uint32_t> slots_;   // key = stock locate, index in books_ or kNoSlot
+    std::vector<uint64_t> touched_; // bit per locate whose shown levels changed since take_depth
+    size_t max_touched_word_ = 0;   // touched_ words past this are all 0
+
+    Book& book_(const uint16_t locate) {
+        uint32_t& slot = slots_[locate];
+        if (slot == kNoSlot) {
+            slot = static_cast<uint32_t>(books_.size());
+            books_.emplace_back();
+            locates_.push_back(locate);
+        }
+        return books_[slot];
+    }
+
+    /* Bids get better as the price goes up, asks as it goes down */
+    static bool better_(const BuySellSide side, const uint32_t a, const uint32_t b) {
+        return side == kBuy ? a > b : a < b;
+    }
+
+    /* Where price's level is in a side's deep levels, or where it would go: every level before it is worse */
+    static size_t find_deep_(const std::vector<BookLevel>& deep, const BuySellSide side, const uint32_t price) {
+        return std::partition_point(deep.begin(), deep.end(),
+            [&](const BookLevel& level) { return better_(side, price, level.price); }) - deep.begin();
+    }
+
+    /* True if the level has no orders left */
+    static bool take_off_(BookLevel& level, const uint32_t shares, const bool order_gone) {
+        level.shares -= std::min<uint64_t>(shares, level.shares);
+        level.orders -= order_gone && level.orders != 0;
+        return level.orders == 0;
+    }
+
+    void touch_(const uint16_t locate) {
+        touched_[locate / 64] |= uint64_t(1) << (locate % 64);
+        max_touched_word_ = std::max<size_t>(max_touched_word_, locate / 64 + 1);
+    }
+};
+
+#endif // ORDER_BOOK_H
@@ -0,0 +1,268 @@
+#ifndef ORDER_STORE_H
+#define ORDER_STORE_H
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "state_image.h"
+#include "trade_types.h"
+
+/*
+    Orders keyed by order reference number.
+
+    Open addressing with Robin Hood probing: a bucket is just (key, slot index, probe distance),
+        16 bytes, and lookups stop as soon as they pass a bucket that is closer to home than they are.
+    The Order records themselves live in a slab pool and never move,
+        so growing the table only moves buckets, and replace_order only moves a key.
+    Removal uses backward shift, no tombstones.
+*/
+class OrderStore {
+public:
+    static constexpr size_t kDefaultExpectedOrders = size_t(1) << 22;
+
+    explicit OrderStore(const size_t expected_orders = kDefaultExpectedOrders) {
+        init_buckets_(capacity_for_(expected_orders));
+        slabs_.reserve(expected_orders / kSlabSize + 1);
+    }
+
+    OrderStore(const OrderStore&) = delete;
+    OrderStore& operator=(const OrderStore&) = delete;
+    OrderStore(OrderStore&&) = default;
+    OrderStore& operator=(OrderStore&&) = default;
+
+    /* Returns false if the reference number is already taken */
+    bool add(const Order& order) {
+        if (find_bucket_(order.order_reference_number) != kNotFound) {
+            return false;
+        }
+        const uint32_t slot = allocate_slot_();
+        order_at_(slot) = order;
+        insert_(order.order_reference_number, slot);
+        return true;
+    }
+
+    Order* find(const uint64_t reference_number) {
+        const size_t bucket = find_bucket_(reference_number);
+        return bucket == kNotFound ? nullptr : &order_at_(buckets_[bucket].slot);
+    }
+
+    /* The order keeps its slot, only its key and the replaced fields change */
+    bool replace(
+        const uint64_t original_reference_number,
+        const uint64_t new_reference_number,
+        const uint32_t shares, const uint32_t price
+    ) {
+        const size_t bucket = find_bucket_(original_reference_number);
+        if (bucket == kNotFound) {
+            return false;
+        }
+        if (find_bucket_(new_reference_number) != kNotFound) {
+            return false;
+        }
+        const uint32_t slot = buckets_[bucket].slot;
+        remove_bucket_(bucket);
+
+        Order& order = order_at_(slot);
+        order.order_reference_number = new_reference_number;
+        order.shares = shares;
+        order.price = price;
+        insert_(new_reference_number, slot);
+        return true;
+    }
+
+    bool erase(const uint64_t reference_number) {
+        const size_t bucket = find_bucket_(reference_number);
+        if (bucket == kNotFound) {
+            return false;
+        }
+        free_slots_.push_back(buckets_[bucket].slot);
+        remove_bucket_(bucket);
+        return true;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    size_t memory_usage() const {
+        return buckets_.capacity() * sizeof(Bucket)
+            + slabs_.size() * kSlabSize * sizeof(Order)
+            + free_slots_.capacity() * sizeof(uint32_t);
+    }
+
+    /*
+        The live orders only, in slot order: the table is only walked to mark the live slots,
+            the slabs are then copied from in order instead of one cache miss per order.
+        Slots and free slots are not kept, they're rebuilt by load.
+    */
+    void save(StateWriter& out) const {
+        std::vector<uint64_t> live((next_fresh_slot_ + 63) / 64);
+        for (const Bucket& bucket: buckets_) {
+            if (bucket.distance != 0) {
+                live[bucket.slot / 64] |= uint64_t(1) << (bucket.slot % 64);
+            }
+        }
+        out.put(size_);
+        char* image = out.extend(size_ * sizeof(Order));
+        for (size_t w = 0; w < live.size(); ++w) {
+            for (uint64_t word = live[w]; word; word &= word - 1) {
+                const size_t slot = w * 64 + __builtin_ctzll(word);
+                std::memcpy(image, &slabs_[slot / kSlabSize][slot % kSlabSize], sizeof(Order));
+                image += sizeof(Order);
+            }
+        }
+    }
+
+    /* Into an empty store, grown once up front to fit the saved orders */
+    bool load(StateReader& in) {
+        size_t count = 0;
+        if (size_ != 0 || !in.get(count)) {
+            return false;
+        }
+        if (capacity_for_(count) > buckets_.size()) {
+            init_buckets_(capacity_for_(count));
+        }
+        Order order;
+        for (size_t i = 0; i < count; ++i) {
+            if (!in.get(order) || !add(order)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* memory_usage() once n orders have been added */
+    static size_t memory_for(const size_t n) {
+        return capacity_for_(n) * sizeof(Bucket) + (n / kSlabSize + 1) * kSlabSize * sizeof(Order);
+    }
+
+private:
+    static constexpr size_t kNotFound = ~size_t(0);
+    static constexpr size_t kSlabSize = size_t(1) << 16; // orders per slab
+    // Grow past 7/8 full
+    static constexpr size_t kMaxLoadNumerator = 7;
+    static constexpr size_t kMaxLoadDenominator = 8;
+
+    struct Bucket {
+        uint64_t key;
+        uint32_t slot;
+        uint32_t distance; // 1 + how far this key sits from its home bucket, 0 = empty
+    };
+
+    std::vector<Bucket> buckets_;
+    size_t mask_ = 0;
+    int shift_ = 0;
+    size_t size_ = 0;
+    size_t grow_at_ = 0;
+
+    std::vector<std::unique_ptr<Order[]>> slabs_;
+    uint32_t next_fresh_slot_ = 0;
+    std::vector<uint32_t> free_slots_;
+
+    /* Smallest table that holds n keys without growing */
+    static size_t capacity_for_(const size_t n) {
+        size_t capacity = 16;
+        while (capacity * kMaxLoadNumerator < n * kMaxLoadDenominator) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    void init_buckets_(const size_t capacity) {
+        buckets_.assign(capacity, Bucket{0, 0, 0});
+        mask_ = capacity - 1;
+        shift_ = 64 - __builtin_ctzll(capacity);
+        grow_at_ = capacity * kMaxLoadNumerator / kMaxLoadDenominator;
+    }
+
+    /* Reference numbers are mostly sequential, Fibonacci hashing spreads them over the table */
+    size_t home_(const uint64_t key) const {
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> shift_);
+    }
+
+    Order& order_at_(const uint32_t slot) {
+        return slabs_[slot / kSlabSize][slot % kSlabSize];
+    }
+
+    uint32_t allocate_slot_() {
+        if (!free_slots_.empty()) {
+            const uint32_t slot = free_slots_.back();
+            free_slots_.pop_back();
+            return slot;
+        }
+        if (next_fresh_slot_ == slabs_.size() * kSlabSize) {
+            slabs_.emplace_back(new Order[kSlabSize]);
+        }
+        return next_fresh_slot_++;
+    }
+
+    size_t find_bucket_(const uint64_t key) const {
+        size_t pos = home_(key);
+        for (uint32_t distance = 1; ; ++distance) {
+            const Bucket& bucket = buckets_[pos];
+            if (bucket.distance < distance) {
+                // Empty, or a key that would have been displaced by ours if ours were here
+                return kNotFound;
+            }
+            if (bucket.key == key) {
+                return pos;
+            }
+            pos = (pos + 1) & mask_;
+        }
+    }
+
+    void insert_(uint64_t key, uint32_t slot) {
+        if (size_ >= grow_at_) {
+            grow_();
+        }
+        insert_no_grow_(key, slot);
+        ++size_;
+    }
+
+    void insert_no_grow_(uint64_t key, uint32_t slot) {
+        size_t pos = home_(key);
+        uint32_t distance = 1;
+        while (true) {
+            Bucket& bucket = buckets_[pos];
+            if (bucket.distance == 0) {
+                bucket = Bucket{key, slot, distance};
+                return;
+            }
+            if (bucket.distance < distance) {
+                // Take from the rich: the resident is closer to home than we are
+                std::swap(bucket.key, key);
+                std::swap(bucket.slot, slot);
+                std::swap(bucket.distance, distance);
+            }
+            pos = (pos + 1) & mask_;
+            ++distance;
+        }
+    }
+
+    void remove_bucket_(size_t pos) {
+        // Backward shift: pull following displaced buckets one step closer to home
+        size_t next = (pos + 1) & mask_;
+        while (buckets_[next].distance > 1) {
+            buckets_[pos] = buckets_[next];
+            --buckets_[pos].distance;
+            pos = next;
+            next = (next + 1) & mask_;
+        }
+        buckets_[pos] = Bucket{0, 0, 0};
+        --size_;
+    }
+
+    void grow_() {
+        std::vector<Bucket> old_buckets;
+        old_buckets.swap(buckets_);
+        init_buckets_(old_buckets.size() * 2);
+        for (const Bucket& bucket: old_buckets) {
+            if (bucket.distance != 0) {
+                insert_no_grow_(bucket.key, bucket.slot);
+            }
+        }
+    }
+};
+
+#endif // ORDER_STORE_H
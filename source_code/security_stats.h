@@ -0,0 +1,74 @@
+#ifndef SECURITY_STATS_H
+#define SECURITY_STATS_H
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "symbol_directory.h"
+#include "trade_types.h"
+#include "utils.h"
+
+/* Integer only: value is exact, VWAP is only rounded once, to the nearest tick, when asked for */
+class SecurityStats {
+    uint64_t traded_shares;
+    Notional total_traded_value; // price ticks * shares
+    bool has_traded; // printed once it has seen a trade, even if that trade was broken later
+public:
+    SecurityStats():
+    traded_shares{0}, total_traded_value{0}, has_traded{false} {}
+    bool handle_trade(const Trade& trade) {
+        traded_shares += trade.shares;
+        total_traded_value += Notional(trade.price) * trade.shares;
+        has_traded = true;
+
+        return true;
+    }
+    bool reverse_trade(const Trade& trade) {
+        traded_shares -= trade.shares;
+        total_traded_value -= Notional(trade.price) * trade.shares;
+        return true;
+    }
+
+    inline bool active() const {
+        return has_traded;
+    }
+
+    /* In 1/10000 ticks, rounded half up */
+    inline uint64_t get_vwap() const {
+        return vwap_4digits(total_traded_value, traded_shares);
+    }
+
+    inline uint64_t get_traded_shares() const {
+        return traded_shares;
+    }
+
+    inline Notional get_traded_value() const {
+        return total_traded_value;
+    }
+
+};
+
+using SecurityStatsArray = std::vector<SecurityStats, CacheAlignedAllocator<SecurityStats>>;
+
+/*
+    Frozen copy of one thread's per-locate stats and symbols, taken at a snapshot boundary.
+    Both are flat arrays indexed by locate, so freezing is two memcpys of the locates in use,
+        and the writer thread computes the VWAPs from the copy while the parser goes on with the live stats.
+    Buffers are recycled by SnapshotWriter, so the arrays only grow when more locates are in use.
+*/
+struct StatsSnapshot {
+    SecurityStatsArray stats;
+    std::vector<SymbolDirectory::Symbol> symbols;
+    size_t count = 0; // locates [0, count) were copied
+
+    void freeze(const SecurityStatsArray& live_stats, const SymbolDirectory& live_symbols, const size_t num_locates) {
+        count = std::min(num_locates, kMaxLocates);
+        if (stats.size() < count) {
+            stats.resize(count);
+            symbols.resize(count);
+        }
+        std::copy_n(live_stats.begin(), count, stats.begin());
+        std::copy_n(live_symbols.symbols().begin(), count, symbols.begin());
+    }
+};
+
+#endif // SECURITY_STATS_H
@@ -0,0 +1,329 @@
+#ifndef SHARED_STATS_H
+#define SHARED_STATS_H
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "security_stats.h"
+#include "spsc_ring.h"
+#include "symbol_directory.h"
+#include "trade_types.h"
+
+/*
+    Live per-locate stats in a named POSIX shared memory segment (--shm=<name>, /dev/shm/<name> on Linux),
+        so other processes on the box can poll the VWAP of any symbol while the day is processed,
+        instead of waiting for the hourly files. See tools/vwap_query.cpp for a reader.
+
+    [SharedStatsHeader]                 64 bytes
+    [SharedStatsSlot] * kMaxLocates     one cache line each, indexed by stock locate
+
+    Each slot is only ever written by the parser thread that owns its locate, at every trade (or broken trade)
+        and at its Stock Directory message. It carries a seqlock: the sequence is odd while the slot is
+        written, a reader copies the slot and tries again if the sequence was odd or changed meanwhile.
+        The parser never waits for a reader, readers never write, so polling costs the parser nothing
+        but the cache lines readers pull away from it. A reader gives up on a slot that stays odd
+        for kSharedStatsReadTimeout, the parser died in the middle of writing it.
+    Volume and notional are published, the VWAP is worked out by the reader (vwap_4digits) so the parser
+        doesn't pay for a 128 bit division at every trade.
+    The segment is left in place at the end of the run, with the final stats, and reset by the next run
+        publishing under the same name.
+*/
+static constexpr char kSharedStatsMagic[8] = {'I', 'T', 'C', 'H', 'V', 'W', 'A', 'P'};
+static constexpr uint32_t kSharedStatsVersion = 1;
+static constexpr auto kSharedStatsReadTimeout = std::chrono::milliseconds(100);
+
+enum SharedStatsState: uint32_t {
+    kSharedStatsRunning = 1,
+    kSharedStatsFinished = 2
+};
+
+struct SharedStatsHeader {
+    std::atomic<uint64_t> magic; // kSharedStatsMagic, stored last, once the segment is ready
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t price_divider; // prices are in 1 / price_divider
+    uint32_t publisher_pid;
+    std::atomic<uint32_t> state; // SharedStatsState
+    uint8_t reserved[36];
+};
+static_assert(sizeof(SharedStatsHeader) == 64);
+
+/* Plain relaxed atomics behind the sequence, so the racy reads of a seqlock are well defined */
+struct alignas(64) SharedStatsSlot {
+    std::atomic<uint64_t> sequence; // odd while the slot is being written
+    std::atomic<uint64_t> symbol;   // the raw 8 bytes, 0 until the Stock Directory message
+    std::atomic<uint64_t> volume;
+    std::atomic<uint64_t> notional_low;
+    std::atomic<uint64_t> notional_high;
+    std::atomic<uint64_t> updated_ns; // timestamp of the last trade (or broken trade)
+};
+static_assert(sizeof(SharedStatsSlot) == 64);
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared between processes, must not need a lock");
+
+static constexpr size_t kSharedStatsSize = sizeof(SharedStatsHeader) + kMaxLocates * sizeof(SharedStatsSlot);
+
+/* One slot, as read by a reader */
+struct SharedStatsRow {
+    SymbolDirectory::Symbol symbol;
+    uint64_t volume;
+    Notional notional;
+    uint64_t updated_ns;
+
+    bool has_symbol() const {
+        return SymbolDirectory::is_set(symbol);
+    }
+
+    /* In 1/10000 ticks, 0 without trades */
+    uint64_t vwap() const {
+        return vwap_4digits(notional, volume);
+    }
+};
+
+/* POSIX shm names are one path component with a leading '/' */
+inline std::string shared_stats_name(const std::string& name) {
+    return name.empty() || name[0] == '/' ? name : "/" + name;
+}
+
+inline SharedStatsSlot* shared_stats_slots(SharedStatsHeader* header) {
+    return reinterpret_cast<SharedStatsSlot*>(header + 1);
+}
+
+/* The parser's side: creates (or resets) the segment, every shard writes the slots of its own locates */
+class SharedStats {
+public:
+    SharedStats() = default;
+    SharedStats(const SharedStats&) = delete;
+    SharedStats& operator=(const SharedStats&) = delete;
+
+    ~SharedStats() {
+        if (header_ != nullptr) {
+            munmap(header_, kSharedStatsSize);
+        }
+    }
+
+    /* Returns false (after printing why) if the segment could not be created */
+    bool open(const std::string& name) {
+        name_ = shared_stats_name(name);
+        const int fd = shm_open(name_.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0) {
+            std::cerr << "Error creating shared memory " << name_ << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        // Never shrunk: readers still mapping what an earlier run left would fault past the new end
+        struct stat st{};
+        const bool sized = fstat(fd, &st) == 0
+            && (static_cast<size_t>(st.st_size) >= kSharedStatsSize || ftruncate(fd, kSharedStatsSize) == 0);
+        void* mapped = sized ? mmap(nullptr, kSharedStatsSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            std::cerr << "Error mapping shared memory " << name_ << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        header_ = static_cast<SharedStatsHeader*>(mapped);
+        slots_ = shared_stats_slots(header_);
+        // An earlier run's values are cleared in place, readers still polling them see every slot start over
+        header_->magic.store(0, std::memory_order_release);
+        for (size_t locate = 0; locate < kMaxLocates; ++locate) {
+            reset_slot_(slots_[locate]);
+        }
+        header_->version = kSharedStatsVersion;
+        header_->slot_count = kMaxLocates;
+        header_->price_divider = PRICE_DIVIDER_4DIGITS;
+        header_->publisher_pid = static_cast<uint32_t>(getpid());
+        header_->state.store(kSharedStatsRunning, std::memory_order_relaxed);
+        uint64_t magic;
+        std::memcpy(&magic, kSharedStatsMagic, sizeof(magic));
+        header_->magic.store(magic, std::memory_order_release);
+        return true;
+    }
+
+    const std::string& name() const {
+        return name_;
+    }
+
+    /* From the thread that owns locate */
+    void publish_symbol(const uint16_t locate, const char* symbol) {
+        uint64_t packed;
+        std::memcpy(&packed, symbol, sizeof(packed));
+        SharedStatsSlot& slot = slots_[locate];
+        begin_write_(slot);
+        slot.symbol.store(packed, std::memory_order_relaxed);
+        end_write_(slot);
+    }
+
+    /* From the thread that owns locate, after every change to its stats */
+    void publish(const uint16_t locate, const SecurityStats& stats, const uint64_t timestamp) {
+        const Notional notional = stats.get_traded_value();
+        SharedStatsSlot& slot = slots_[locate];
+        begin_write_(slot);
+        slot.volume.store(stats.get_traded_shares(), std::memory_order_relaxed);
+        slot.notional_low.store(static_cast<uint64_t>(notional), std::memory_order_relaxed);
+        slot.notional_high.store(static_cast<uint64_t>(notional >> 64), std::memory_order_relaxed);
+        slot.updated_ns.store(timestamp, std::memory_order_relaxed);
+        end_write_(slot);
+    }
+
+    /* Every shard is done, the slots have their final values */
+    void finish() {
+        if (header_ != nullptr) {
+            header_->state.store(kSharedStatsFinished, std::memory_order_release);
+        }
+    }
+
+    static bool unlink(const std::string& name) {
+        return shm_unlink(shared_stats_name(name).c_str()) == 0;
+    }
+
+private:
+    std::string name_;
+    SharedStatsHeader* header_ = nullptr;
+    SharedStatsSlot* slots_ = nullptr;
+
+    /* Single writer per slot: the sequence is only ever changed by this thread, no read-modify-write needed */
+    static void begin_write_(SharedStatsSlot& slot) {
+        slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    static void end_write_(SharedStatsSlot& slot) {
+        slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /* Zeroes a slot under its seqlock, also one left odd by a run that died in the middle of writing it */
+    static void reset_slot_(SharedStatsSlot& slot) {
+        slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) | 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.symbol.store(0, std::memory_order_relaxed);
+        slot.volume.store(0, std::memory_order_relaxed);
+        slot.notional_low.store(0, std::memory_order_relaxed);
+        slot.notional_high.store(0, std::memory_order_relaxed);
+        slot.updated_ns.store(0, std::memory_order_relaxed);
+        end_write_(slot);
+    }
+};
+
+/* The other processes' side: maps the segment read only, reads never block the parser */
+class SharedStatsReader {
+public:
+    SharedStatsReader() = default;
+    SharedStatsReader(const SharedStatsReader&) = delete;
+    SharedStatsReader& operator=(const SharedStatsReader&) = delete;
+
+    ~SharedStatsReader() {
+        if (header_ != nullptr) {
+            munmap(const_cast<SharedStatsHeader*>(header_), kSharedStatsSize);
+        }
+    }
+
+    /* Returns false if there is no segment of that name (yet), or it isn't one of ours */
+    bool open(const std::string& name) {
+        const std::string shm_name = shared_stats_name(name);
+        const int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            error_ = std::string("no shared memory ") + shm_name + ": " + std::strerror(errno);
+            return false;
+        }
+        struct stat st{};
+        const bool sized = fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= kSharedStatsSize;
+        void* mapped = sized ? mmap(nullptr, kSharedStatsSize, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            error_ = shm_name + " is too small or could not be mapped";
+            return false;
+        }
+        header_ = static_cast<const SharedStatsHeader*>(mapped);
+        uint64_t magic;
+        std::memcpy(&magic, kSharedStatsMagic, sizeof(magic));
+        if (header_->magic.load(std::memory_order_acquire) != magic || header_->version != kSharedStatsVersion
+            || header_->slot_count != kMaxLocates) {
+            error_ = shm_name + " is not a VWAP segment of this version (or not ready yet)";
+            return false;
+        }
+        slots_ = shared_stats_slots(const_cast<SharedStatsHeader*>(header_));
+        return true;
+    }
+
+    const std::string& error() const {
+        return error_;
+    }
+
+    bool finished() const {
+        return header_->state.load(std::memory_order_acquire) == kSharedStatsFinished;
+    }
+
+    uint32_t publisher_pid() const {
+        return header_->publisher_pid;
+    }
+
+    /*
+        A consistent copy of locate's slot, retried while the parser is writing it: spinning a little first,
+            a write takes nanoseconds, then yielding in case the parser was preempted in the middle of one.
+        Returns false if the slot was still being written after kSharedStatsReadTimeout, the publisher is gone.
+    */
+    bool read(const uint16_t locate, SharedStatsRow& row) const {
+        static constexpr int kSpins = 1000;
+        const SharedStatsSlot& slot = slots_[locate];
+        std::chrono::steady_clock::time_point deadline{};
+        for (int attempt = 0; ; ++attempt) {
+            if (attempt >= kSpins) {
+                const auto now = std::chrono::steady_clock::now();
+                if (attempt == kSpins) {
+                    deadline = now + kSharedStatsReadTimeout;
+                } else if (now > deadline) {
+                    return false;
+                }
+                std::this_thread::yield();
+            } else if (attempt != 0) {
+                cpu_relax();
+            }
+            const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+            const uint64_t symbol = slot.symbol.load(std::memory_order_relaxed);
+            row.volume = slot.volume.load(std::memory_order_relaxed);
+            const uint64_t low = slot.notional_low.load(std::memory_order_relaxed);
+            const uint64_t high = slot.notional_high.load(std::memory_order_relaxed);
+            row.updated_ns = slot.updated_ns.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) == before) {
+                std::memcpy(row.symbol.data(), &symbol, kSymbolLength);
+                row.notional = (Notional(high) << 64) | low;
+                return true;
+            }
+        }
+    }
+
+    /* Linear scan of the symbols, for looking a symbol up once (symbol may be given without the space padding), slots that can't be read are skipped */
+    bool find(const std::string& symbol, uint16_t& locate) const {
+        if (symbol.empty() || symbol.size() > kSymbolLength) {
+            return false;
+        }
+        SymbolDirectory::Symbol padded;
+        padded.fill(' ');
+        std::memcpy(padded.data(), symbol.data(), symbol.size());
+        SharedStatsRow row;
+        for (size_t i = 0; i < kMaxLocates; ++i) {
+            if (read(static_cast<uint16_t>(i), row) && row.symbol == padded) {
+                locate = static_cast<uint16_t>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    const SharedStatsHeader* header_ = nullptr;
+    const SharedStatsSlot* slots_ = nullptr;
+    std::string error_;
+};
+
+#endif // SHARED_STATS_H
@@ -0,0 +1,188 @@
+#ifndef SNAPSHOT_FILE_H
+#define SNAPSHOT_FILE_H
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+#include "symbol_directory.h"
+#include "trade_types.h"
+
+/*
+    Binary snapshot file, written by the 'binary' output format: every VWAP snapshot of the day
+        in one file, columnar, fixed width, little endian, so it can be mmapped and used in place.
+
+    [SnapshotFileHeader]            64 bytes
+    [block] [block] ...             one per snapshot, each column holds row_count values back to back,
+                                        widest first so every column is naturally aligned:
+        notional    u128            sum of price ticks * shares
+        vwap        u64             1/10000 ticks, rounded half up
+        volume      u64             shares
+        interval    u64             ns since midnight of the boundary the snapshot was taken at
+        symbol      char[8]         raw, right padded with spaces
+        locate      u16
+        padding to a multiple of 16 bytes
+    [SnapshotIndexEntry] ...        one per snapshot, in file order
+    [SnapshotFileTrailer]           32 bytes, at the very end, points at the index
+
+    Rows are in locate order within a snapshot, same as the csv/log files.
+*/
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "snapshot files are little endian and read in place");
+
+static constexpr char kSnapshotFileMagic[8] = {'I', 'T', 'C', 'H', 'S', 'N', 'A', 'P'};
+static constexpr char kSnapshotTrailerMagic[8] = {'S', 'N', 'A', 'P', 'I', 'D', 'X', '1'};
+static constexpr uint32_t kSnapshotFileVersion = 1;
+
+struct SnapshotFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t price_divider; // prices are in 1 / price_divider
+    uint8_t reserved[44];
+};
+static_assert(sizeof(SnapshotFileHeader) == 64);
+
+struct SnapshotIndexEntry {
+    uint64_t interval_ns;
+    uint64_t offset; // of the block, from the start of the file
+    uint64_t row_count;
+};
+
+struct SnapshotFileTrailer {
+    uint64_t index_offset;
+    uint64_t snapshot_count;
+    uint64_t reserved;
+    char magic[8];
+};
+static_assert(sizeof(SnapshotFileTrailer) == 32);
+
+/* Where each column of a block with row_count rows starts, relative to the block */
+struct SnapshotBlockLayout {
+    uint64_t notional;
+    uint64_t vwap;
+    uint64_t volume;
+    uint64_t interval;
+    uint64_t symbol;
+    uint64_t locate;
+    uint64_t size;
+
+    explicit SnapshotBlockLayout(const uint64_t row_count) {
+        notional = 0;
+        vwap = notional + row_count * sizeof(Notional);
+        volume = vwap + row_count * sizeof(uint64_t);
+        interval = volume + row_count * sizeof(uint64_t);
+        symbol = interval + row_count * sizeof(uint64_t);
+        locate = symbol + row_count * kSymbolLength;
+        size = (locate + row_count * sizeof(uint16_t) + 15) / 16 * 16;
+    }
+};
+
+/* One snapshot, pointing straight into the mapped file */
+struct SnapshotView {
+    uint64_t interval_ns;
+    size_t row_count;
+    const Notional* notional;
+    const uint64_t* vwap;
+    const uint64_t* volume;
+    const uint64_t* interval;
+    const char* symbols; // kSymbolLength bytes per row, not null terminated
+    const uint16_t* locate;
+
+    const char* symbol(const size_t row) const {
+        return symbols + row * kSymbolLength;
+    }
+};
+
+/*
+    Maps a snapshot file and hands out its snapshots, nothing is copied or parsed.
+    open() checks the header, trailer and index, and fails (with the reason in error())
+        on anything that doesn't look like a complete snapshot file, e.g. one still being written.
+*/
+class SnapshotFileReader {
+public:
+    bool open(const std::string& path) {
+        index_ = nullptr;
+        count_ = 0;
+        if (!file_.open(path)) {
+            error_ = "can't open " + path;
+            return false;
+        }
+        const char* data = file_.data();
+        const uint64_t size = file_.size();
+        if (size < sizeof(SnapshotFileHeader) + sizeof(SnapshotFileTrailer)) {
+            error_ = "file too short";
+            return false;
+        }
+        SnapshotFileHeader header;
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, kSnapshotFileMagic, sizeof(kSnapshotFileMagic)) != 0
+            || header.version != kSnapshotFileVersion) {
+            error_ = "not a snapshot file, or an unsupported version";
+            return false;
+        }
+        SnapshotFileTrailer trailer;
+        std::memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+        if (std::memcmp(trailer.magic, kSnapshotTrailerMagic, sizeof(kSnapshotTrailerMagic)) != 0) {
+            error_ = "no index, the file is incomplete";
+            return false;
+        }
+        const uint64_t index_end = size - sizeof(trailer);
+        if (trailer.index_offset > index_end
+            || (index_end - trailer.index_offset) / sizeof(SnapshotIndexEntry) < trailer.snapshot_count
+            || trailer.index_offset % alignof(SnapshotIndexEntry) != 0) {
+            error_ = "corrupt index";
+            return false;
+        }
+        index_ = reinterpret_cast<const SnapshotIndexEntry*>(data + trailer.index_offset);
+        for (uint64_t i = 0; i < trailer.snapshot_count; ++i) {
+            const SnapshotIndexEntry& entry = index_[i];
+            if (entry.offset % 16 != 0 || entry.offset > trailer.index_offset
+                || entry.row_count > (trailer.index_offset - entry.offset) / 8
+                || SnapshotBlockLayout(entry.row_count).size > trailer.index_offset - entry.offset) {
+                error_ = "corrupt index entry " + std::to_string(i);
+                index_ = nullptr;
+                return false;
+            }
+        }
+        count_ = trailer.snapshot_count;
+        price_divider_ = header.price_divider;
+        return true;
+    }
+
+    const std::string& error() const {
+        return error_;
+    }
+
+    size_t size() const {
+        return count_;
+    }
+
+    uint32_t price_divider() const {
+        return price_divider_;
+    }
+
+    SnapshotView snapshot(const size_t i) const {
+        const SnapshotIndexEntry& entry = index_[i];
+        const char* block = file_.data() + entry.offset;
+        const SnapshotBlockLayout layout(entry.row_count);
+        return SnapshotView{
+            entry.interval_ns,
+            entry.row_count,
+            reinterpret_cast<const Notional*>(block + layout.notional),
+            reinterpret_cast<const uint64_t*>(block + layout.vwap),
+            reinterpret_cast<const uint64_t*>(block + layout.volume),
+            reinterpret_cast<const uint64_t*>(block + layout.interval),
+            block + layout.symbol,
+            reinterpret_cast<const uint16_t*>(block + layout.locate)
+        };
+    }
+
+private:
+    MappedFile file_;
+    const SnapshotIndexEntry* index_ = nullptr;
+    size_t count_ = 0;
+    uint32_t price_divider_ = PRICE_DIVIDER_4DIGITS;
+    std::string error_;
+};
+
+#endif // SNAPSHOT_FILE_H
@@ -0,0 +1,179 @@
+#ifndef SNAPSHOT_FORMAT_H
+#define SNAPSHOT_FORMAT_H
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bar_engine.h"
+#include "order_book.h"
+#include "security_stats.h"
+#include "symbol_directory.h"
+#include "trade_types.h"
+
+/*
+    What the snapshot writer does with frozen stats, bar rows and book rows before they hit the disk:
+        VWAP rows out of the frozen stats, and their text formats.
+    Rows are formatted by hand (to_chars) into one buffer, nothing is allocated once the buffer has grown.
+*/
+
+/* One line of a VWAP snapshot */
+struct VwapRow {
+    uint16_t stock_locate;
+    SymbolDirectory::Symbol symbol;
+    uint64_t vwap; // 1/10000 ticks
+    uint64_t volume;
+    Notional notional;
+};
+
+/* VWAP rows in locate order of every locate that traded, out of the shards' frozen stats */
+inline void collect_vwap_rows(const std::vector<std::unique_ptr<StatsSnapshot>>& snapshots, std::vector<VwapRow>& rows) {
+    rows.clear();
+    for (const auto& snapshot: snapshots) {
+        for (size_t locate = 0; locate < snapshot->count; ++locate) {
+            const SecurityStats& stats = snapshot->stats[locate];
+            const SymbolDirectory::Symbol& symbol = snapshot->symbols[locate];
+            if (!stats.active() || !SymbolDirectory::is_set(symbol)) {
+                continue;
+            }
+            rows.push_back(VwapRow{static_cast<uint16_t>(locate), symbol, stats.get_vwap(),
+                stats.get_traded_shares(), stats.get_traded_value()});
+        }
+    }
+    if (snapshots.size() > 1) {
+        std::sort(rows.begin(), rows.end(),
+            [](const VwapRow& a, const VwapRow& b) { return a.stock_locate < b.stock_locate; });
+    }
+}
+
+/* Room for n more characters at the end of buffer, give back what's unused with buffer.resize(end - data) */
+inline char* grow_buffer(std::string& buffer, const size_t n) {
+    const size_t used = buffer.size();
+    buffer.resize(used + n);
+    return buffer.data() + used;
+}
+
+/* The whole <hour>.log file into buffer */
+inline void format_vwaps_log(std::string& buffer, const int hour, const std::vector<VwapRow>& rows) {
+    constexpr size_t kMaxRowLength = kSymbolLength + 1 + 25 + 1;
+    buffer.clear();
+    char* out = grow_buffer(buffer, 32 + rows.size() * kMaxRowLength + 33);
+    if (hour < 10) {
+        *out++ = '0';
+    }
+    out = std::to_chars(out, out + 11, hour).ptr;
+    out = std::copy_n(":00:00\n", 7, out);
+    for (const VwapRow& row: rows) {
+        out = std::copy_n(row.symbol.data(), kSymbolLength, out);
+        *out++ = ' ';
+        out = format_price_4digits(out, row.vwap);
+        *out++ = '\n';
+    }
+    out = std::copy_n("-------------------------------\n\n", 33, out);
+    buffer.resize(out - buffer.data());
+}
+
+/* The whole <hour>.csv file into buffer */
+inline void format_vwaps_csv(std::string& buffer, const int hour, const std::vector<VwapRow>& rows) {
+    constexpr size_t kMaxRowLength = 11 + 1 + kSymbolLength + 1 + 25 + 1;
+    buffer.clear();
+    char* out = grow_buffer(buffer, 17 + rows.size() * kMaxRowLength);
+    out = std::copy_n("hour,symbol,vwap\n", 17, out);
+    for (const VwapRow& row: rows) {
+        out = std::to_chars(out, out + 11, hour).ptr;
+        *out++ = ',';
+        out = std::copy_n(row.symbol.data(), kSymbolLength, out);
+        *out++ = ',';
+        out = format_price_4digits(out, row.vwap);
+        *out++ = '\n';
+    }
+    buffer.resize(out - buffer.data());
+}
+
+/* hh:mm:ss of a timestamp, for the bar and book files */
+inline std::array<char, 8> format_time_of_day(const uint64_t timestamp) {
+    const uint64_t seconds = timestamp / 1'000'000'000;
+    return {
+        char('0' + seconds / 36000), char('0' + seconds / 3600 % 10), ':',
+        char('0' + seconds / 600 % 6), char('0' + seconds / 60 % 10), ':',
+        char('0' + seconds / 10 % 6), char('0' + seconds % 10)
+    };
+}
+
+/* Appends the bars.csv lines of the bar that started at bar_start to buffer */
+inline void append_bars_csv(std::string& buffer, const uint64_t bar_start, const std::vector<BarRow>& rows) {
+    const std::array<char, 8> time = format_time_of_day(bar_start);
+
+    constexpr size_t kMaxRowLength = 9 + kSymbolLength + 1 + 5 * 26 + 2 * 21;
+    char* out = grow_buffer(buffer, rows.size() * kMaxRowLength);
+    for (const BarRow& row: rows) {
+        out = std::copy_n(time.data(), 8, out);
+        *out++ = ',';
+        out = std::copy_n(row.symbol.data(), kSymbolLength, out);
+        *out++ = ',';
+        for (const uint64_t price: {uint64_t(row.open), uint64_t(row.high), uint64_t(row.low), uint64_t(row.close)}) {
+            out = format_price_4digits(out, price);
+            *out++ = ',';
+        }
+        out = std::to_chars(out, out + 20, row.volume).ptr;
+        *out++ = ',';
+        out = format_price_4digits(out, vwap_4digits(row.notional, row.volume));
+        *out++ = ',';
+        out = std::to_chars(out, out + 20, row.trades).ptr;
+        *out++ = '\n';
+    }
+    buffer.resize(out - buffer.data());
+}
+
+/*
+    Appends the book.csv lines of the books as they were at time to buffer:
+        one line per level (1 = best) of each symbol, bid and ask side by side, a side without that level left empty.
+*/
+inline void append_book_csv(std::string& buffer, const uint64_t time, const std::vector<BookRow>& rows) {
+    const std::array<char, 8> time_of_day = format_time_of_day(time);
+
+    constexpr size_t kMaxLineLength = 9 + kSymbolLength + 1 + 3 + 2 * (11 + 21 + 26) + 6;
+    size_t lines = 0;
+    for (const BookRow& row: rows) {
+        lines += std::max(row.bid_levels, row.ask_levels);
+    }
+    char* out = grow_buffer(buffer, lines * kMaxLineLength);
+    for (const BookRow& row: rows) {
+        const size_t levels = std::max(row.bid_levels, row.ask_levels);
+        for (size_t i = 0; i < levels; ++i) {
+            out = std::copy_n(time_of_day.data(), 8, out);
+            *out++ = ',';
+            out = std::copy_n(row.symbol.data(), kSymbolLength, out);
+            *out++ = ',';
+            out = std::to_chars(out, out + 3, i + 1).ptr;
+            *out++ = ',';
+            if (i < row.bid_levels) {
+                const BookLevel& bid = row.bids[i];
+                out = std::to_chars(out, out + 11, bid.orders).ptr;
+                *out++ = ',';
+                out = std::to_chars(out, out + 20, bid.shares).ptr;
+                *out++ = ',';
+                out = format_price_4digits(out, bid.price);
+            } else {
+                out = std::copy_n(",,", 2, out);
+            }
+            *out++ = ',';
+            if (i < row.ask_levels) {
+                const BookLevel& ask = row.asks[i];
+                out = format_price_4digits(out, ask.price);
+                *out++ = ',';
+                out = std::to_chars(out, out + 20, ask.shares).ptr;
+                *out++ = ',';
+                out = std::to_chars(out, out + 11, ask.orders).ptr;
+            } else {
+                out = std::copy_n(",,", 2, out);
+            }
+            *out++ = '\n';
+        }
+    }
+    buffer.resize(out - buffer.data());
+}
+
+#endif // SNAPSHOT_FORMAT_H
@@ -0,0 +1,584 @@
+#ifndef SNAPSHOT_WRITER_H
+#define SNAPSHOT_WRITER_H
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bar_engine.h"
+#include "checkpoint.h"
+#include "metrics.h"
+#include "order_book.h"
+#include "security_stats.h"
+#include "snapshot_file.h"
+#include "snapshot_format.h"
+#include "symbol_directory.h"
+#include "trade_types.h"
+
+/*
+    Writes VWAP snapshots out in the requested format.
+    With several shards, every shard hands in its own stats (or bar rows),
+        and the snapshot is written once the last shard has handed in its part.
+    Rows are written in locate order, so the output doesn't depend on how many shards there are.
+    The binary format puts every snapshot in one columnar snapshots.bin instead, see snapshot_file.h.
+    Bars, when enabled, are all appended to one bars.csv in the output directory, whatever the format,
+        and so is the order book (book.csv) with a book depth.
+
+    VWAPs, formatting and file I/O happen on the writer's own thread: submitting only queues a frozen
+        copy of the stats (or the bar rows), so a parser never waits on the disk at a boundary. Rows are formatted
+        (see snapshot_format.h) into one buffer per file and written in one go, bars are buffered and written in large chunks.
+    finish() (or the destructor) writes out whatever is still queued.
+
+    Live input (see write_as_submitted) is written as it comes instead: every job wakes the writer and bars are
+        flushed after each wakeup, and the time from reading the message that crossed a boundary to the output
+        for it being written is kept in output_latency().
+
+    Checkpoints are written here too, once every shard has handed in its image (submit_checkpoint).
+        By then everything the shards submitted before the boundary is queued ahead of it, so the checkpoint
+        also records how much of bars.csv, book.csv and snapshots.bin was written, and a resumed run
+        (constructed with that checkpoint) cuts them back to there and appends.
+*/
+class SnapshotWriter {
+public:
+    enum class PrintFormat {
+        csv,
+        log,
+        binary
+    };
+
+    /* resume_from: carry on the output of the run that wrote this checkpoint, see resumed() */
+    SnapshotWriter(const std::string& output_dir_path, const PrintFormat& format, const size_t num_shards = 1,
+        const bool write_bars = false, const bool write_book = false, const Checkpoint* resume_from = nullptr)
+    : output_dir_{output_dir_path}, print_format_{format}, num_shards_{num_shards} {
+        if (!std::filesystem::exists(output_dir_path)) {
+            try {
+                std::filesystem::create_directories(output_dir_path);
+            } catch (...) {
+                std::cerr << "Error creating directory: " << output_dir_path << std::endl;
+            }
+        }
+        resumed_ = resume_from != nullptr && restore_output_(resume_from->output_state, write_bars, write_book);
+        if (write_bars && !resumed_) {
+            open_csv_file_("bars.csv", bars_ofs_);
+            bars_buffer_ = "time,symbol,open,high,low,close,volume,vwap,trades\n";
+        }
+        if (write_book && !resumed_) {
+            open_csv_file_("book.csv", book_ofs_);
+            book_buffer_ = "time,symbol,level,bid_orders,bid_shares,bid_price,ask_price,ask_shares,ask_orders\n";
+        }
+        if (print_format_ == PrintFormat::binary && !resumed_) {
+            open_binary_file_();
+        }
+        // Allocated (and page faulted) up front, so the first boundaries don't pay for it on the parser threads
+        for (size_t i = 0; i < 2 * num_shards_; ++i) {
+            std::unique_ptr<StatsSnapshot>& snapshot = spare_snapshots_.emplace_back(std::make_unique<StatsSnapshot>());
+            snapshot->stats.resize(kMaxLocates);
+            snapshot->symbols.resize(kMaxLocates);
+        }
+        writer_thread_ = std::thread(&SnapshotWriter::write_jobs_, this);
+    }
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    ~SnapshotWriter() {
+        finish();
+    }
+
+    /* False if the output could not be picked up where the checkpoint left it, it was then started over */
+    bool resumed() const {
+        return resumed_;
+    }
+
+    /* Live input: no batching of bars, output is written as soon as it is submitted */
+    void write_as_submitted() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        live_ = true;
+    }
+
+    /* Nanoseconds from reading the message that crossed a boundary to its output written, live input only */
+    const LatencyHistogram& output_latency() const {
+        return output_latency_;
+    }
+
+    /* Checkpoints go to path, header has the run's settings (see CheckpointHeader), the rest is filled in here */
+    void enable_checkpoints(const std::string& path, const CheckpointHeader& header) {
+        checkpoint_path_ = path;
+        checkpoint_header_ = header;
+    }
+
+    /* Called by each shard at each hourly boundary with its state image, from the shard's thread */
+    void submit_checkpoint(const size_t shard, const uint64_t input_offset, const uint64_t timestamp, std::string&& image) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        PendingCheckpoint& pending = pending_checkpoints_[input_offset];
+        pending.images.resize(num_shards_);
+        pending.images[shard] = std::move(image);
+        if (++pending.submitted < num_shards_) {
+            return;
+        }
+        Job& job = jobs_.emplace_back();
+        job.is_checkpoint = true;
+        job.input_offset = input_offset;
+        job.bar_start = timestamp;
+        job.images = std::move(pending.images);
+        pending_checkpoints_.erase(input_offset);
+        wake_writer_(true);
+    }
+
+    /* A buffer to freeze stats into, handed back with submit_stats */
+    std::unique_ptr<StatsSnapshot> acquire_stats_snapshot() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!spare_snapshots_.empty()) {
+                std::unique_ptr<StatsSnapshot> snapshot = std::move(spare_snapshots_.back());
+                spare_snapshots_.pop_back();
+                return snapshot;
+            }
+        }
+        return std::make_unique<StatsSnapshot>();
+    }
+
+    /*
+        Called by each shard at each snapshot boundary, from the shard's thread.
+        read_ns: steady_ns() when the message that crossed the boundary was read, 0 if not known.
+    */
+    void submit_stats(const int hour, std::unique_ptr<StatsSnapshot>&& snapshot, const uint64_t read_ns = 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<std::unique_ptr<StatsSnapshot>>& pending = pending_[hour];
+        pending.push_back(std::move(snapshot));
+        if (pending.size() < num_shards_) {
+            return;
+        }
+        Job& job = jobs_.emplace_back();
+        job.hour = hour;
+        job.read_ns = read_ns;
+        job.stats = std::move(pending);
+        pending_.erase(hour);
+        wake_writer_(true);
+    }
+
+    /* Same as submit_vwaps, for the bar that started at bar_start */
+    void submit_bars(const uint64_t bar_start, const std::vector<BarRow>& rows, const uint64_t read_ns = 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<BarRow> merged;
+        if (num_shards_ > 1) {
+            if (!merge_(pending_bars_, bar_start, rows)) {
+                return;
+            }
+            merged = std::move(pending_bars_[bar_start].rows);
+            pending_bars_.erase(bar_start);
+        } else if (!rows.empty()) {
+            // Vectors come back from the writer thread, so this doesn't allocate once warmed up
+            if (!spare_bar_rows_.empty()) {
+                merged = std::move(spare_bar_rows_.back());
+                spare_bar_rows_.pop_back();
+            }
+            merged.assign(rows.begin(), rows.end());
+        }
+        if (merged.empty()) {
+            return;
+        }
+        Job& job = jobs_.emplace_back();
+        job.is_bars = true;
+        job.bar_start = bar_start;
+        job.read_ns = read_ns;
+        job.bars = std::move(merged);
+        wake_writer_(false);
+    }
+
+    /* Same as submit_bars, for the books as they were at time */
+    void submit_book(const uint64_t time, const std::vector<BookRow>& rows, const uint64_t read_ns = 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<BookRow> merged;
+        if (num_shards_ > 1) {
+            if (!merge_(pending_books_, time, rows)) {
+                return;
+            }
+            merged = std::move(pending_books_[time].rows);
+            pending_books_.erase(time);
+        } else if (!rows.empty()) {
+            if (!spare_book_rows_.empty()) {
+                merged = std::move(spare_book_rows_.back());
+                spare_book_rows_.pop_back();
+            }
+            merged.assign(rows.begin(), rows.end());
+        }
+        if (merged.empty()) {
+            return;
+        }
+        Job& job = jobs_.emplace_back();
+        job.is_book = true;
+        job.bar_start = time;
+        job.read_ns = read_ns;
+        job.book = std::move(merged);
+        wake_writer_(false);
+    }
+
+    /* Writes out everything submitted so far and stops the writer thread */
+    void finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finishing_ = true;
+            jobs_ready_.notify_one();
+        }
+        if (writer_thread_.joinable()) {
+            writer_thread_.join();
+        }
+    }
+
+private:
+    template <typename Row>
+    struct PendingSnapshot {
+        std::vector<Row> rows;
+        size_t submitted = 0;
+    };
+
+    struct Job {
+        bool is_bars = false;
+        bool is_book = false;
+        bool is_checkpoint = false;
+        int hour = 0;
+        uint64_t bar_start = 0; // boundary timestamp for books and checkpoints
+        uint64_t input_offset = 0;
+        uint64_t read_ns = 0;
+        std::vector<std::unique_ptr<StatsSnapshot>> stats; // one per shard
+        std::vector<BarRow> bars;
+        std::vector<BookRow> book;
+        std::vector<std::string> images; // one per shard
+    };
+
+    struct PendingCheckpoint {
+        std::vector<std::string> images;
+        size_t submitted = 0;
+    };
+
+    static constexpr size_t kBarsFlushSize = size_t(1) << 20;
+    /*
+        Bars don't wake the writer one by one, a wakeup costs the parser a syscall (and the core, if there's only one).
+        The writer picks them up once this many are queued, with the next snapshot, or after kMaxWriteDelay.
+    */
+    static constexpr size_t kBarJobsPerWake = 64;
+    static constexpr std::chrono::milliseconds kMaxWriteDelay{100};
+
+    std::string output_dir_;
+    PrintFormat print_format_;
+    size_t num_shards_;
+
+    std::ofstream bars_ofs_;
+    uint64_t bars_size_ = 0; // bytes written to bars.csv
+    std::string bars_buffer_; // formatted bar rows not written yet
+    std::ofstream book_ofs_;
+    uint64_t book_size_ = 0; // bytes written to book.csv
+    std::string book_buffer_;
+    std::string file_buffer_; // one snapshot file
+    std::vector<VwapRow> vwap_rows_; // one snapshot, reused
+
+    // Binary format, writer thread only
+    std::ofstream binary_ofs_;
+    uint64_t binary_offset_ = 0;
+    std::vector<SnapshotIndexEntry> binary_index_;
+
+    std::mutex mutex_;
+    std::condition_variable jobs_ready_;
+    std::deque<Job> jobs_;
+    std::vector<std::vector<BarRow>> spare_bar_rows_;
+    std::vector<std::vector<BookRow>> spare_book_rows_;
+    std::vector<std::unique_ptr<StatsSnapshot>> spare_snapshots_;
+    bool writer_waiting_ = false;
+    bool finishing_ = false;
+    std::thread writer_thread_;
+
+    // Stats handed in so far, a snapshot is complete once every shard is in. Accessed under mutex_
+    std::map<int, std::vector<std::unique_ptr<StatsSnapshot>>> pending_; // key = hour
+    // Sharded mode only, accessed under mutex_
+    std::map<uint64_t, PendingSnapshot<BarRow>> pending_bars_; // key = bar start
+    std::map<uint64_t, PendingSnapshot<BookRow>> pending_books_; // key = boundary time
+    std::map<uint64_t, PendingCheckpoint> pending_checkpoints_; // key = input offset
+
+    std::string checkpoint_path_;
+    CheckpointHeader checkpoint_header_{};
+    bool resumed_ = false;
+
+    bool live_ = false; // accessed under mutex_
+    LatencyHistogram output_latency_;
+
+    /* Adds one shard's rows, returns true once every shard is in and the rows are sorted by locate */
+    template <typename Key, typename Row>
+    bool merge_(std::map<Key, PendingSnapshot<Row>>& pending_map, const Key key, const std::vector<Row>& rows) {
+        PendingSnapshot<Row>& pending = pending_map[key];
+        pending.rows.insert(pending.rows.end(), rows.begin(), rows.end());
+        if (++pending.submitted < num_shards_) {
+            return false;
+        }
+        std::sort(pending.rows.begin(), pending.rows.end(),
+            [](const Row& a, const Row& b) { return a.stock_locate < b.stock_locate; });
+        return true;
+    }
+
+    /* Called under mutex_ after queueing a job */
+    void wake_writer_(const bool urgent) {
+        if (writer_waiting_ && (urgent || live_ || jobs_.size() >= kBarJobsPerWake)) {
+            jobs_ready_.notify_one();
+        }
+    }
+
+    /* Writer thread: takes everything queued at once, writes it with the lock released */
+    void write_jobs_() {
+        std::deque<Job> jobs;
+        bool live = false;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                for (Job& job: jobs) {
+                    if (job.is_bars && spare_bar_rows_.size() < kBarJobsPerWake * 2) {
+                        spare_bar_rows_.push_back(std::move(job.bars));
+                    }
+                    if (job.is_book && spare_book_rows_.size() < kBarJobsPerWake * 2) {
+                        spare_book_rows_.push_back(std::move(job.book));
+                    }
+                    for (auto& snapshot: job.stats) {
+                        spare_snapshots_.push_back(std::move(snapshot));
+                    }
+                }
+                jobs.clear();
+                writer_waiting_ = true;
+                jobs_ready_.wait_for(lock, kMaxWriteDelay, [this] { return !jobs_.empty() || finishing_; });
+                writer_waiting_ = false;
+                if (jobs_.empty()) {
+                    if (finishing_) {
+                        break;
+                    }
+                    continue;
+                }
+                jobs.swap(jobs_);
+                live = live_;
+            }
+            for (Job& job: jobs) {
+                if (job.is_bars) {
+                    format_bars_(job.bar_start, job.bars);
+                } else if (job.is_book) {
+                    append_book_csv(book_buffer_, job.bar_start, job.book);
+                    if (book_buffer_.size() >= kBarsFlushSize) {
+                        flush_bars_();
+                    }
+                } else if (job.is_checkpoint) {
+                    write_checkpoint_(job);
+                } else {
+                    collect_vwap_rows(job.stats, vwap_rows_);
+                    print_vwaps_(job.hour, vwap_rows_);
+                }
+            }
+            if (live) {
+                flush_bars_();
+                const uint64_t now = steady_ns();
+                for (const Job& job: jobs) {
+                    if (job.read_ns != 0) {
+                        output_latency_.record(now - job.read_ns);
+                    }
+                }
+            }
+        }
+        flush_bars_();
+        close_binary_file_();
+    }
+
+    void print_vwaps_(const int hour, const std::vector<VwapRow>& rows) {
+        switch(print_format_) {
+            case PrintFormat::csv: {
+                format_vwaps_csv(file_buffer_, hour, rows);
+                write_file_(std::to_string(hour) + ".csv");
+                break;
+            }
+            case PrintFormat::log: {
+                format_vwaps_log(file_buffer_, hour, rows);
+                write_file_(std::to_string(hour) + ".log");
+                break;
+            }
+            case PrintFormat::binary: {
+                append_binary_block_(uint64_t(hour) * 3600 * 1'000'000'000, rows);
+            }
+        }
+    }
+
+    void open_binary_file_() {
+        const std::string output_file = output_dir_ + "/snapshots.bin";
+        binary_ofs_.open(output_file, std::ios::binary | std::ios::trunc);
+        if (!binary_ofs_.is_open()) {
+            std::cerr << "Error opening output file " << output_file << std::endl;
+            return;
+        }
+        SnapshotFileHeader header{};
+        std::memcpy(header.magic, kSnapshotFileMagic, sizeof(header.magic));
+        header.version = kSnapshotFileVersion;
+        header.header_size = sizeof(SnapshotFileHeader);
+        header.price_divider = PRICE_DIVIDER_4DIGITS;
+        binary_ofs_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        binary_offset_ = sizeof(header);
+    }
+
+    /* One snapshot as a block of columns, see snapshot_file.h */
+    void append_binary_block_(const uint64_t interval_ns, const std::vector<VwapRow>& rows) {
+        const size_t n = rows.size();
+        const SnapshotBlockLayout layout(n);
+        file_buffer_.assign(layout.size, '\0');
+        char* block = file_buffer_.data();
+        for (size_t i = 0; i < n; ++i) {
+            const VwapRow& row = rows[i];
+            std::memcpy(block + layout.notional + i * sizeof(Notional), &row.notional, sizeof(Notional));
+            std::memcpy(block + layout.vwap + i * sizeof(uint64_t), &row.vwap, sizeof(uint64_t));
+            std::memcpy(block + layout.volume + i * sizeof(uint64_t), &row.volume, sizeof(uint64_t));
+            std::memcpy(block + layout.interval + i * sizeof(uint64_t), &interval_ns, sizeof(uint64_t));
+            std::memcpy(block + layout.symbol + i * kSymbolLength, row.symbol.data(), kSymbolLength);
+            std::memcpy(block + layout.locate + i * sizeof(uint16_t), &row.stock_locate, sizeof(uint16_t));
+        }
+        binary_ofs_.write(file_buffer_.data(), file_buffer_.size());
+        binary_index_.push_back(SnapshotIndexEntry{interval_ns, binary_offset_, n});
+        binary_offset_ += layout.size;
+    }
+
+    /* Index and trailer go at the end, a file without them is rejected by SnapshotFileReader */
+    void close_binary_file_() {
+        if (!binary_ofs_.is_open()) {
+            return;
+        }
+        SnapshotFileTrailer trailer{};
+        trailer.index_offset = binary_offset_;
+        trailer.snapshot_count = binary_index_.size();
+        std::memcpy(trailer.magic, kSnapshotTrailerMagic, sizeof(trailer.magic));
+        binary_ofs_.write(reinterpret_cast<const char*>(binary_index_.data()),
+            binary_index_.size() * sizeof(SnapshotIndexEntry));
+        binary_ofs_.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+        binary_ofs_.close();
+    }
+
+    void write_file_(const std::string& file_name) {
+        const std::string output_file = output_dir_ + "/" + file_name;
+        std::ofstream ofs(output_file, std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            std::cerr << "Error opening output file " << output_file << std::endl;
+            return;
+        }
+        ofs.write(file_buffer_.data(), file_buffer_.size());
+    }
+
+    void format_bars_(const uint64_t bar_start, const std::vector<BarRow>& rows) {
+        append_bars_csv(bars_buffer_, bar_start, rows);
+        if (bars_buffer_.size() >= kBarsFlushSize) {
+            flush_bars_();
+        }
+    }
+
+    /* bars.csv and book.csv */
+    void flush_bars_() {
+        flush_csv_(bars_ofs_, bars_buffer_, bars_size_);
+        flush_csv_(book_ofs_, book_buffer_, book_size_);
+    }
+
+    static void flush_csv_(std::ofstream& ofs, std::string& buffer, uint64_t& size) {
+        if (ofs.is_open() && !buffer.empty()) {
+            ofs.write(buffer.data(), buffer.size());
+            ofs.flush();
+            size += buffer.size();
+        }
+        buffer.clear();
+    }
+
+    void open_csv_file_(const std::string& file_name, std::ofstream& ofs) {
+        const std::string output_file = output_dir_ + "/" + file_name;
+        ofs.open(output_file, std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            std::cerr << "Error opening output file " << output_file << std::endl;
+        }
+    }
+
+    /* Everything queued before it is written, the output files are flushed so their sizes are final */
+    void write_checkpoint_(Job& job) {
+        if (checkpoint_path_.empty()) {
+            return;
+        }
+        flush_bars_();
+        if (binary_ofs_.is_open()) {
+            binary_ofs_.flush();
+        }
+        Checkpoint checkpoint;
+        checkpoint.header = checkpoint_header_;
+        checkpoint.header.input_offset = job.input_offset;
+        checkpoint.header.timestamp = job.bar_start;
+        StateWriter output;
+        save_output_(output);
+        checkpoint.output_state = std::move(output.data());
+        checkpoint.shards = std::move(job.images);
+        save_checkpoint(checkpoint_path_, checkpoint);
+    }
+
+    /* How far the output files got: bars.csv and book.csv sizes, snapshots.bin size and index */
+    void save_output_(StateWriter& out) const {
+        out.put(bars_size_);
+        out.put(book_size_);
+        out.put(binary_offset_);
+        out.put(binary_index_.size());
+        out.put_array(binary_index_.data(), binary_index_.size());
+    }
+
+    /* Cuts the output files back to where the checkpoint was taken and reopens them for appending */
+    bool restore_output_(const std::string& state, const bool write_bars, const bool write_book) {
+        StateReader in(state);
+        size_t index_size = 0;
+        if (!in.get(bars_size_) || !in.get(book_size_) || !in.get(binary_offset_) || !in.get(index_size)) {
+            return false;
+        }
+        binary_index_.resize(index_size);
+        if (!in.get_array(binary_index_.data(), index_size) || !in.done()) {
+            return false;
+        }
+        const bool binary = print_format_ == PrintFormat::binary;
+        if (!truncate_output_("bars.csv", write_bars ? bars_size_ : 0)
+            || !truncate_output_("book.csv", write_book ? book_size_ : 0)
+            || !truncate_output_("snapshots.bin", binary ? binary_offset_ : 0)) {
+            bars_size_ = 0;
+            book_size_ = 0;
+            binary_offset_ = 0;
+            binary_index_.clear();
+            return false;
+        }
+        if (write_bars) {
+            bars_ofs_.open(output_dir_ + "/bars.csv", std::ios::binary | std::ios::app);
+        }
+        if (write_book) {
+            book_ofs_.open(output_dir_ + "/book.csv", std::ios::binary | std::ios::app);
+        }
+        if (binary) {
+            binary_ofs_.open(output_dir_ + "/snapshots.bin", std::ios::binary | std::ios::app);
+        }
+        return (!write_bars || bars_ofs_.is_open()) && (!write_book || book_ofs_.is_open())
+            && (!binary || binary_ofs_.is_open());
+    }
+
+    /* size 0: the file isn't written by this run. Fails if the file is shorter than size */
+    bool truncate_output_(const std::string& file_name, const uint64_t size) {
+        if (size == 0) {
+            return true;
+        }
+        const std::filesystem::path path = std::filesystem::path(output_dir_) / file_name;
+        std::error_code error;
+        const uint64_t file_size = std::filesystem::file_size(path, error);
+        if (error || file_size < size) {
+            std::cerr << "Output file " << path.string() << " is shorter than at the checkpoint" << std::endl;
+            return false;
+        }
+        std::filesystem::resize_file(path, size, error);
+        return !error;
+    }
+};
+
+#endif // SNAPSHOT_WRITER_H
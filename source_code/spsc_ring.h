@@ -0,0 +1,275 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "metrics.h"
+
+/* How a side of the ring waits when the ring is full (producer) or empty (consumer) */
+enum class WaitStrategy {
+    spin,   // busy wait, lowest latency, burns a core per waiting thread
+    yield,  // busy wait but give up the time slice every time
+    futex   // spin a little, then sleep in the kernel until the other side wakes us up
+};
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+static inline void futex_wait(std::atomic<uint32_t>& word, const uint32_t expected) {
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+static inline void futex_wake_all(std::atomic<uint32_t>& word) {
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+/*
+    Fixed-capacity single-producer/single-consumer ring.
+    Slots are allocated once up front, the producer fills them in place and the consumer reads them in place.
+
+    Producer: claim() a slot, fill it, commit(). Committed slots become visible to the consumer
+        in batches of batch_size (or on flush()/close()), so there is one release store and
+        at most one wake-up per batch instead of one per message.
+    Consumer: acquire() returns how many slots are readable, at(i) reads them, release(n) hands them back.
+
+    claim() blocks while the ring is full, which is what keeps memory bounded
+        when the consumer falls behind.
+    Each side counts how often and how long it waited on the other, and the consumer keeps the
+        deepest backlog it found (high_water()). Only measured on the slow path, where the side
+        has to look at the other's position anyway.
+*/
+template <typename T>
+class SpscRing {
+public:
+    static constexpr size_t kCacheLine = 64;
+
+    SpscRing(const size_t capacity, const WaitStrategy wait_strategy = WaitStrategy::futex, const size_t batch_size = 256)
+    : wait_strategy_{wait_strategy} {
+        size_t rounded = 2;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+        slots_.resize(rounded);
+        mask_ = rounded - 1;
+        batch_size_ = std::max<size_t>(1, std::min(batch_size, rounded / 2));
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const {
+        return slots_.size();
+    }
+
+    /* ---------------- Producer side ---------------- */
+
+    T& claim() {
+        if (claim_pos_ - cached_head_ >= slots_.size()) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (claim_pos_ - cached_head_ >= slots_.size()) {
+                wait_for_space_();
+            }
+        }
+        return slots_[claim_pos_ & mask_];
+    }
+
+    void commit() {
+        ++claim_pos_;
+        if (claim_pos_ - published_pos_ >= batch_size_) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (published_pos_ == claim_pos_) {
+            return;
+        }
+        published_pos_ = claim_pos_;
+        tail_.store(published_pos_, std::memory_order_release);
+        notify_(data_seq_, consumer_waiting_);
+    }
+
+    /* No more messages after this. The consumer drains what is left and then sees 0 */
+    void close() {
+        flush();
+        closed_.store(true, std::memory_order_release);
+        notify_(data_seq_, consumer_waiting_);
+    }
+
+    /* ---------------- Consumer side ---------------- */
+
+    size_t acquire() {
+        if (cached_tail_ == read_pos_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (cached_tail_ == read_pos_) {
+                wait_for_data_();
+            }
+            high_water_.set_max(cached_tail_ - read_pos_);
+        }
+        return cached_tail_ - read_pos_;
+    }
+
+    T& at(const size_t i) {
+        return slots_[(read_pos_ + i) & mask_];
+    }
+
+    void release(const size_t n) {
+        read_pos_ += n;
+        head_.store(read_pos_, std::memory_order_release);
+        notify_(space_seq_, producer_waiting_);
+    }
+
+    bool closed() const {
+        return closed_.load(std::memory_order_acquire);
+    }
+
+    /* ---------------- Stats, readable from any thread ---------------- */
+
+    /* Times the producer found the ring full, and the ns it waited */
+    uint64_t full_waits() const {
+        return full_waits_.get();
+    }
+
+    uint64_t full_wait_ns() const {
+        return full_wait_ns_.get();
+    }
+
+    /* Times the consumer found the ring empty, and the ns it waited */
+    uint64_t empty_waits() const {
+        return empty_waits_.get();
+    }
+
+    uint64_t empty_wait_ns() const {
+        return empty_wait_ns_.get();
+    }
+
+    /* Most slots the consumer ever found waiting for it */
+    uint64_t high_water() const {
+        return high_water_.get();
+    }
+
+private:
+    static constexpr int kSpinsBeforeSleep = 256;
+
+    WaitStrategy wait_strategy_;
+    std::vector<T> slots_;
+    size_t mask_;
+    size_t batch_size_;
+
+    // Shared positions, each on its own cache line
+    alignas(kCacheLine) std::atomic<uint64_t> tail_{0}; // published by producer
+    alignas(kCacheLine) std::atomic<uint64_t> head_{0}; // released by consumer
+    alignas(kCacheLine) std::atomic<bool> closed_{false};
+
+    // Futex words and "someone is sleeping" flags, only touched on the slow path
+    alignas(kCacheLine) std::atomic<uint32_t> data_seq_{0};
+    std::atomic<uint32_t> consumer_waiting_{0};
+    alignas(kCacheLine) std::atomic<uint32_t> space_seq_{0};
+    std::atomic<uint32_t> producer_waiting_{0};
+
+    // Producer-only state
+    alignas(kCacheLine) uint64_t claim_pos_ = 0;
+    uint64_t published_pos_ = 0;
+    uint64_t cached_head_ = 0;
+    Counter full_waits_;
+    Counter full_wait_ns_;
+
+    // Consumer-only state
+    alignas(kCacheLine) uint64_t read_pos_ = 0;
+    uint64_t cached_tail_ = 0;
+    Counter empty_waits_;
+    Counter empty_wait_ns_;
+    Counter high_water_;
+
+    /* claim() found the ring full */
+    void wait_for_space_() {
+        // Make sure the consumer can see everything before we wait on it
+        flush();
+        const uint64_t wait_start = steady_ns();
+        wait_(space_seq_, producer_waiting_, [&] {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            return claim_pos_ - cached_head_ < slots_.size();
+        });
+        full_waits_.add();
+        full_wait_ns_.add(steady_ns() - wait_start);
+    }
+
+    /* acquire() found the ring empty */
+    void wait_for_data_() {
+        const uint64_t wait_start = steady_ns();
+        wait_(data_seq_, consumer_waiting_, [&] {
+            // Load closed_ first so a close() racing with us can't hide the last batch
+            const bool closed = closed_.load(std::memory_order_acquire);
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            return cached_tail_ != read_pos_ || closed;
+        });
+        empty_waits_.add();
+        empty_wait_ns_.add(steady_ns() - wait_start);
+    }
+
+    template <typename Ready>
+    void wait_(std::atomic<uint32_t>& seq, std::atomic<uint32_t>& waiting, Ready&& ready) {
+        switch(wait_strategy_) {
+            case WaitStrategy::spin: {
+                while (!ready()) {
+                    cpu_relax();
+                }
+                return;
+            }
+            case WaitStrategy::yield: {
+                while (!ready()) {
+                    std::this_thread::yield();
+                }
+                return;
+            }
+            case WaitStrategy::futex: {
+                for (int i = 0; i < kSpinsBeforeSleep; ++i) {
+                    if (ready()) {
+                        return;
+                    }
+                    cpu_relax();
+                }
+                while (true) {
+                    // Announce we're about to sleep, then re-check so a concurrent notify_ can't be missed
+                    waiting.store(1, std::memory_order_seq_cst);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    const uint32_t observed = seq.load(std::memory_order_seq_cst);
+                    if (ready()) {
+                        waiting.store(0, std::memory_order_relaxed);
+                        return;
+                    }
+                    futex_wait(seq, observed);
+                    waiting.store(0, std::memory_order_relaxed);
+                    if (ready()) {
+                        return;
+                    }
+                }
+            }
+        }
+    }
+
+    void notify_(std::atomic<uint32_t>& seq, std::atomic<uint32_t>& waiting) {
+        if (wait_strategy_ != WaitStrategy::futex) {
+            return;
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed)) {
+            seq.fetch_add(1, std::memory_order_seq_cst);
+            futex_wake_all(seq);
+        }
+    }
+};
+
+#endif // SPSC_RING_H
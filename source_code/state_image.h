@@ -0,0 +1,81 @@
+#ifndef STATE_IMAGE_H
+#define STATE_IMAGE_H
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+/*
+    Flat byte image of in-memory state, for checkpoints (see checkpoint.h).
+    Values are copied as they are in memory, so an image is only read back by the same build on the same machine.
+    Each class saves its own state into a StateWriter and reads it back from a StateReader, in the same order.
+*/
+class StateWriter {
+public:
+    template <typename T>
+    void put(const T& value) {
+        put_array(&value, 1);
+    }
+
+    template <typename T>
+    void put_array(const T* values, const size_t n) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        data_.append(reinterpret_cast<const char*>(values), n * sizeof(T));
+    }
+
+    void reserve(const size_t n) {
+        data_.reserve(n);
+    }
+
+    /* Room for n more bytes at the end, to be memcpy'd into (cheaper than a put per value) */
+    char* extend(const size_t n) {
+        const size_t at = data_.size();
+        data_.resize(at + n);
+        return data_.data() + at;
+    }
+
+    std::string& data() {
+        return data_;
+    }
+
+private:
+    std::string data_;
+};
+
+/* Reads a StateWriter image back. Reading past the end fails (returns false) and keeps failing */
+class StateReader {
+public:
+    StateReader(const char* data, const size_t size): pos_{data}, end_{data + size} {}
+    explicit StateReader(const std::string& data): StateReader(data.data(), data.size()) {}
+
+    template <typename T>
+    bool get(T& value) {
+        return get_array(&value, 1);
+    }
+
+    template <typename T>
+    bool get_array(T* values, const size_t n) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (failed_ || size_t(end_ - pos_) / sizeof(T) < n) {
+            failed_ = true;
+            return false;
+        }
+        if (n != 0) {
+            std::memcpy(static_cast<void*>(values), pos_, n * sizeof(T));
+        }
+        pos_ += n * sizeof(T);
+        return true;
+    }
+
+    /* Everything was read, and nothing more */
+    bool done() const {
+        return !failed_ && pos_ == end_;
+    }
+
+private:
+    const char* pos_;
+    const char* end_;
+    bool failed_ = false;
+};
+
+#endif // STATE_IMAGE_H
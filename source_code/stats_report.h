@@ -0,0 +1,196 @@
+#ifndef STATS_REPORT_H
+#define STATS_REPORT_H
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "message_parser.h"
+#include "message_reader.h"
+#include "metrics.h"
+#include "snapshot_writer.h"
+
+/*
+    The stats file (--stats): what the reader, decoders and parsers counted, see metrics.h.
+    Written at the end of the run and, with an interval, every interval while it runs,
+        from a thread of its own that only reads the counters.
+    Each write appends one block starting with a '#' line, so the file is a time series
+        and the last block is the final one.
+*/
+class StatsReport {
+public:
+    StatsReport(const std::string& path, const uint64_t interval_ns, const MessageReader& reader,
+        const std::vector<std::unique_ptr<MessageParser>>& parsers, const SnapshotWriter& writer)
+    : path_{path}, interval_ns_{interval_ns}, reader_{reader}, parsers_{parsers}, writer_{writer}, start_ns_{steady_ns()} {}
+
+    StatsReport(const StatsReport&) = delete;
+    StatsReport& operator=(const StatsReport&) = delete;
+
+    ~StatsReport() {
+        stop_();
+    }
+
+    /* Opens (truncates) the file and starts the interval writes. Returns false if the file can't be opened */
+    bool start() {
+        ofs_.open(path_, std::ios::trunc);
+        if (!ofs_.is_open()) {
+            std::cerr << "Error opening stats file " << path_ << std::endl;
+            return false;
+        }
+        if (interval_ns_ != 0) {
+            thread_ = std::thread(&StatsReport::write_every_interval_, this);
+        }
+        return true;
+    }
+
+    /* Once everything has stopped: the final block */
+    void finish() {
+        stop_();
+        if (ofs_.is_open()) {
+            write_(true);
+            if (!ofs_) {
+                std::cerr << "Error writing stats file " << path_ << std::endl;
+            }
+        }
+    }
+
+private:
+    std::string path_;
+    uint64_t interval_ns_;
+    const MessageReader& reader_;
+    const std::vector<std::unique_ptr<MessageParser>>& parsers_;
+    const SnapshotWriter& writer_;
+    uint64_t start_ns_;
+    std::ofstream ofs_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable stop_requested_;
+    bool stopping_ = false;
+
+    void write_every_interval_() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_requested_.wait_for(lock, std::chrono::nanoseconds(interval_ns_), [&] { return stopping_; })) {
+            write_(false);
+        }
+    }
+
+    void stop_() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            stop_requested_.notify_one();
+        }
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    static double seconds_(const uint64_t ns) {
+        return double(ns) / 1e9;
+    }
+
+    void write_(const bool final) {
+        std::ostream& out = ofs_;
+        out << std::fixed << std::setprecision(3);
+        out << "# " << seconds_(steady_ns() - start_ns_) << " s" << (final ? ", final" : "") << std::endl;
+
+        // Whichever threads framed the file, added up
+        std::vector<const DecodeMetrics*> framing{&reader_.metrics()};
+        for (const auto& metrics: reader_.decoder_metrics()) {
+            framing.push_back(metrics.get());
+        }
+        uint64_t messages = 0, bytes = 0;
+        std::vector<uint64_t> by_type(256), skipped(256), malformed(256);
+        for (const DecodeMetrics* metrics: framing) {
+            bytes += metrics->bytes.get();
+            for (size_t type = 0; type < 256; ++type) {
+                by_type[type] += metrics->messages[type].get();
+                skipped[type] += metrics->skipped[type].get();
+                malformed[type] += metrics->malformed[type].get();
+            }
+        }
+        for (const uint64_t count: by_type) {
+            messages += count;
+        }
+
+        const uint64_t read_ns = reader_.metrics().time.elapsed_ns();
+        out << "reader: " << messages << " messages, " << bytes << " bytes, " << seconds_(read_ns) << " s";
+        if (read_ns != 0) {
+            out << ", " << double(messages) / seconds_(read_ns) / 1e6 << " M messages/s";
+        }
+        out << ", " << reader_.filtered() << " dropped by the watchlist" << std::endl;
+        if (const uint64_t inflate_ns = reader_.inflate_time().elapsed_ns()) {
+            out << "inflate: " << seconds_(inflate_ns) << " s" << std::endl;
+        }
+        if (reader_.reads_feed()) {
+            const FeedMetrics& feed = reader_.feed_metrics();
+            out << "feed: " << feed.packets.get() << " packets, " << feed.gaps.get() << " gaps, "
+            << feed.lost.get() << " messages lost, " << feed.duplicates.get() << " duplicates, "
+            << feed.malformed.get() << " malformed" << std::endl;
+        }
+        for (size_t k = 0; k < reader_.decoder_metrics().size(); ++k) {
+            out << "decoder " << k << ": " << seconds_(reader_.decoder_metrics()[k]->time.elapsed_ns()) << " s" << std::endl;
+        }
+        out << "      type    messages     skipped   malformed" << std::endl;
+        for (size_t type = 0; type < 256; ++type) {
+            if (by_type[type] != 0) {
+                out << "  " << std::setw(8) << char(type) << std::setw(12) << by_type[type]
+                << std::setw(12) << skipped[type] << std::setw(12) << malformed[type] << std::endl;
+            }
+        }
+
+        // Live input only: from reading the message that crossed a boundary to its output written
+        const LatencyHistogram& output_latency = writer_.output_latency();
+        if (output_latency.count() != 0) {
+            out << "tick to output: " << output_latency.count() << " boundaries" << std::setprecision(0)
+            << ", mean " << double(output_latency.sum()) / double(output_latency.count()) / 1e3 << " us";
+            for (const auto& [name, q]: {std::pair{"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99}}) {
+                out << ", " << name << " " << double(output_latency.quantile(q)) / 1e3 << " us";
+            }
+            out << ", max " << double(output_latency.max()) / 1e3 << " us" << std::setprecision(3) << std::endl;
+        }
+
+        const double ticks_per_ns = CycleClock::ticks_per_ns();
+        for (const auto& parser: parsers_) {
+            const ParseMetrics& metrics = parser->metrics();
+            const MessageReader::MessageRing& ring = reader_.ring(parser->shard());
+            out << "shard " << parser->shard() << ": " << metrics.processed.get() << " messages, "
+            << seconds_(metrics.time.elapsed_ns()) << " s, "
+            << seconds_(ring.empty_wait_ns()) << " s waiting for messages (" << ring.empty_waits() << " times), "
+            << "queue high water " << ring.high_water() << " of " << ring.capacity() << ", "
+            << "reader waited on a full queue " << ring.full_waits() << " times ("
+            << seconds_(ring.full_wait_ns()) << " s)" << std::endl;
+
+            out << "      type     sampled    mean ns     p50 ns     p90 ns     p99 ns   p99.9 ns     max ns" << std::endl;
+            for (size_t i = 0; i < kMessageTypes.size(); ++i) {
+                const LatencyHistogram& latency = metrics.latency[i];
+                if (latency.count() == 0) {
+                    continue;
+                }
+                out << "  " << std::setw(8) << type_name_(kMessageTypes[i]) << std::setw(12) << latency.count()
+                << std::setprecision(0)
+                << std::setw(11) << double(latency.sum()) / double(latency.count()) / ticks_per_ns;
+                for (const double q: {0.5, 0.9, 0.99, 0.999}) {
+                    out << std::setw(11) << double(latency.quantile(q)) / ticks_per_ns;
+                }
+                out << std::setw(11) << double(latency.max()) / ticks_per_ns << std::setprecision(3) << std::endl;
+            }
+        }
+        out << std::endl;
+    }
+
+    static std::string type_name_(const char type) {
+        if (type == SnapshotBoundaryMessage::kType) {
+            return "boundary";
+        }
+        return std::string(1, type);
+    }
+};
+
+#endif // STATS_REPORT_H
@@ -0,0 +1,133 @@
+#ifndef SYMBOL_DIRECTORY_H
+#define SYMBOL_DIRECTORY_H
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include "state_image.h"
+
+static constexpr size_t kSymbolLength = 8;
+static constexpr size_t kMaxLocates = size_t(1) << 16; // stock_locate is 2 bytes
+
+/*
+    Stock locate <-> symbol, filled from Stock Directory messages.
+    Locate codes are dense and fit in 16 bits, so locate -> symbol is a flat array indexed by locate.
+    symbol -> locate is only needed off the hot path, a sorted table of packed symbols is enough.
+    Symbols are kept as the raw 8 bytes from the feed (right padded with spaces).
+*/
+class SymbolDirectory {
+public:
+    using Symbol = std::array<char, kSymbolLength>;
+
+    SymbolDirectory(): symbols_(kMaxLocates) {}
+
+    /* Returns false if the locate or the symbol is already taken by something else */
+    bool add(const uint16_t locate, const char* symbol) {
+        Symbol& existing = symbols_[locate];
+        if (is_set_(existing)) {
+            return std::memcmp(existing.data(), symbol, kSymbolLength) == 0;
+        }
+
+        const uint64_t key = pack_symbol(symbol);
+        auto found = std::lower_bound(sorted_symbols_.begin(), sorted_symbols_.end(), key,
+            [](const std::pair<uint64_t, uint16_t>& entry, const uint64_t k) { return entry.first < k; });
+        if (found != sorted_symbols_.end() && found->first == key) {
+            return false;
+        }
+        sorted_symbols_.insert(found, {key, locate});
+        std::memcpy(existing.data(), symbol, kSymbolLength);
+        return true;
+    }
+
+    bool contains(const uint16_t locate) const {
+        return is_set_(symbols_[locate]);
+    }
+
+    /* Flat locate -> symbol table, unset entries start with a null byte (see is_set) */
+    const std::vector<Symbol>& symbols() const {
+        return symbols_;
+    }
+
+    static bool is_set(const Symbol& symbol) {
+        return is_set_(symbol);
+    }
+
+    /* The 8 raw bytes of the symbol, not null terminated */
+    const char* get(const uint16_t locate) const {
+        return symbols_[locate].data();
+    }
+
+    bool get_symbol(const uint16_t locate, std::string& symbol) const {
+        if (!contains(locate)) {
+            return false;
+        }
+        symbol.assign(get(locate), kSymbolLength);
+        return true;
+    }
+
+    /* symbol may be given with or without the trailing space padding */
+    bool get_locate(const std::string& symbol, uint16_t& locate) const {
+        if (symbol.size() > kSymbolLength) {
+            return false;
+        }
+        char padded[kSymbolLength];
+        std::memset(padded, ' ', kSymbolLength);
+        std::memcpy(padded, symbol.data(), symbol.size());
+
+        const uint64_t key = pack_symbol(padded);
+        auto found = std::lower_bound(sorted_symbols_.begin(), sorted_symbols_.end(), key,
+            [](const std::pair<uint64_t, uint16_t>& entry, const uint64_t k) { return entry.first < k; });
+        if (found == sorted_symbols_.end() || found->first != key) {
+            return false;
+        }
+        locate = found->second;
+        return true;
+    }
+
+    /* (locate, symbol) of every known locate */
+    void save(StateWriter& out) const {
+        out.put(sorted_symbols_.size());
+        for (const auto& [key, locate]: sorted_symbols_) {
+            out.put(locate);
+            out.put(symbols_[locate]);
+        }
+    }
+
+    /* Into an empty directory */
+    bool load(StateReader& in) {
+        size_t count = 0;
+        if (!sorted_symbols_.empty() || !in.get(count) || count > kMaxLocates) {
+            return false;
+        }
+        uint16_t locate = 0;
+        Symbol symbol;
+        for (size_t i = 0; i < count; ++i) {
+            if (!in.get(locate) || !in.get(symbol) || !is_set_(symbol) || !add(locate, symbol.data())) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* Big endian packing, so packed keys sort the same way as the symbols do */
+    static uint64_t pack_symbol(const char* symbol) {
+        uint64_t key = 0;
+        for (size_t i = 0; i < kSymbolLength; ++i) {
+            key = (key << 8) | static_cast<uint8_t>(symbol[i]);
+        }
+        return key;
+    }
+
+private:
+    std::vector<Symbol> symbols_; // index = stock locate, all zero if unknown
+    std::vector<std::pair<uint64_t, uint16_t>> sorted_symbols_; // (packed symbol, locate), sorted by symbol
+
+    static bool is_set_(const Symbol& symbol) {
+        return symbol[0] != '\0';
+    }
+};
+
+#endif // SYMBOL_DIRECTORY_H
@@ -1,262 +1,376 @@
 #ifndef SYSTEM_DATA_H
 #define SYSTEM_DATA_H
+#include <algorithm>
 #include <cstdint>
 #include <cassert>
+#include <memory>
 #include <string>
-#include <unordered_map>
-#include <filesystem>
+#include <vector>
 #include <iostream>
-#include <iomanip>
+#include "bar_engine.h"
+#include "order_book.h"
+#include "order_store.h"
+#include "security_stats.h"
+#include "shared_stats.h"
+#include "snapshot_writer.h"
+#include "state_image.h"
+#include "symbol_directory.h"
+#include "trade_ledger.h"
 #include "trade_types.h"
 #include "utils.h"
 
-class SecurityStats {
-    uint16_t stock_locate;
-    uint64_t traded_shares;
-    float total_traded_value;
-public:
-    SecurityStats(const uint16_t locate):
-    stock_locate{locate}, traded_shares{0}, total_traded_value{0} {}
-    bool handle_trade(const Trade& trade) {
-        traded_shares += trade.shares;
-        total_traded_value += trade.price * trade.shares;
-
-        return true;
-    }
-    bool reverse_trade(const Trade& trade) {
-        traded_shares -= trade.shares;
-        total_traded_value -= trade.price * trade.shares;
-        return true;
-    }
-
-    inline float get_vwap() const {
-        return traded_shares == 0 ? 0 : total_traded_value / traded_shares;
-    }
-
-};
-
+/*
+    Order, trade and per-locate state of one processing thread.
+    Single-threaded, there is one SystemData for everything.
+    Sharded, there is one per shard, each only seeing the locates routed to it,
+        and snapshot boundaries come from the reader (snapshot_boundary) instead of
+        from this shard's own timestamps, so all shards snapshot at the same point of the stream.
+    Same with a watchlist, where the reader drops the messages of the other symbols.
+    Boundaries are the hourly VWAP snapshots and, with a bar interval, the end of every bar.
+    Live input (--follow, stdin) also gets its boundaries from the reader, stamped with the time the message that
+        crossed them was read, which goes with the output to the writer to measure tick-to-output latency.
+    With checkpoints, every hourly boundary also saves this state (see save) and hands it to the writer,
+        which writes the checkpoint once every shard's is in. Boundaries then come from the reader,
+        with the input offset of the message that crossed them.
+    With a book depth, the orders are also kept in an OrderBook by price level: executions, cancels and
+        deletes take shares off them (and them off the book once none are left), and the top levels
+        of the symbols whose book changed go to the writer at every bar, or every hour without bars.
+        Orders with no shares left stay in the store like the others: a later execution of one still
+        finds its price, so the VWAPs are the same with or without the book.
+    With shared stats, every change to a locate's stats (and its symbol) is also published to its slot
+        in the shared memory segment, for other processes to read (see shared_stats.h).
+*/
 class SystemData {
 public:
 
-    enum class PrintFormat {
-        csv,
-        log
-    };
-
-    SystemData(const std::string& output_dir_path, const PrintFormat& format)
-    : output_dir_{output_dir_path}, print_format_{format} {
-        if (!std::filesystem::exists(output_dir_path)) {
-            try {
-                std::filesystem::create_directories(output_dir_path);
-            } catch (...) {
-                std::cerr << "Error creating directory: " << output_dir_path << std::endl;
-            }
-        }
-    }
+    SystemData(SnapshotWriter& writer,
+        const size_t expected_orders = OrderStore::kDefaultExpectedOrders,
+        const bool external_boundaries = false,
+        const uint64_t bar_interval_ns = 0,
+        const size_t book_depth = 0)
+    : sec_stats_(kMaxLocates), orders_(expected_orders), bars_(bar_interval_ns), book_(book_depth),
+    writer_{writer}, external_boundaries_{external_boundaries} {}
 
     void market_open() {
         market_open_ = true;
     }
 
     void update_timestamp(const uint64_t timestamp) {
-        int current_hour = get_hour_by_timestamp(latest_timestamp_);
-        int potential_next_hour = get_hour_by_timestamp(timestamp);
-        if (market_open_ && current_hour < potential_next_hour) {
-            print_vwaps_(potential_next_hour);
+        if (!external_boundaries_) {
+            advance_clock_(timestamp);
         }
         latest_timestamp_ = timestamp; 
     }
-    bool add_stock_record(uint16_t locate, const std::string& symbol) {
-        auto found_locate = locate_to_symbol_map.find(locate);
-        if (found_locate == locate_to_symbol_map.end()) {
-            locate_to_symbol_map.emplace(locate, symbol);
-        } else {
-            if (found_locate->second != symbol) {
-                return false;
+
+    /* Save this shard's state at every hourly boundary, as part number shard of the checkpoint */
+    void enable_checkpoints(const size_t shard) {
+        checkpoints_ = true;
+        shard_ = shard;
+    }
+
+    /* Publish the stats of this shard's locates to shared, what it has so far (after a resume) right away */
+    void enable_shared_stats(SharedStats& shared) {
+        shared_ = &shared;
+        for (size_t locate = 0; locate < kMaxLocates; ++locate) {
+            if (symbols_.contains(locate)) {
+                shared_->publish_symbol(locate, symbols_.get(locate));
             }
         }
-        
-        auto found_symbol = symbol_to_locate_map.find(symbol);
-        if (found_symbol == symbol_to_locate_map.end()) {
-            symbol_to_locate_map.emplace(symbol, locate);
-        } else {
-            if (found_symbol->second != locate) {
-                return false;
+        for (size_t locate = 0; locate <= max_traded_locate_; ++locate) {
+            if (sec_stats_[locate].active()) {
+                shared_->publish(locate, sec_stats_[locate], latest_timestamp_);
             }
         }
+    }
 
-        return true;
+    /*
+        The stream crossed a snapshot boundary at timestamp (sharded mode),
+            input_offset is where the message that crossed it starts in the data file,
+            read_ns when it was read (live input only, else 0).
+    */
+    void snapshot_boundary(const uint64_t timestamp, const uint64_t input_offset = 0, const uint64_t read_ns = 0) {
+        const int hour = get_hour_by_timestamp(latest_timestamp_);
+        boundary_read_ns_ = read_ns;
+        advance_clock_(timestamp);
+        latest_timestamp_ = timestamp;
+        if (checkpoints_ && hour < get_hour_by_timestamp(timestamp)) {
+            checkpoint_(input_offset, timestamp);
+        }
     }
 
-    bool get_symbol_by_locate(const uint16_t locate, std::string& symbol) {
-        auto found_locate = locate_to_symbol_map.find(locate);
-        if (found_locate == locate_to_symbol_map.end()) {
+    /* Everything a restart needs, see state_image.h */
+    void save(StateWriter& out) const {
+        out.put(latest_timestamp_);
+        out.put(market_open_);
+        out.put(max_traded_locate_);
+        out.put_array(sec_stats_.data(), max_traded_locate_ + 1);
+        symbols_.save(out);
+        orders_.save(out);
+        trades_.save(out);
+        bars_.save(out);
+        book_.save(out);
+    }
+
+    /* Into a SystemData that hasn't processed anything yet, with the same bar interval and book depth */
+    bool load(StateReader& in) {
+        return in.get(latest_timestamp_) && in.get(market_open_)
+            && in.get(max_traded_locate_) && max_traded_locate_ < kMaxLocates
+            && in.get_array(sec_stats_.data(), max_traded_locate_ + 1)
+            && symbols_.load(in) && orders_.load(in) && trades_.load(in) && bars_.load(in)
+            && book_.load(in) && in.done();
+    }
+
+    const SymbolDirectory& symbols() const {
+        return symbols_;
+    }
+
+    /* End of the data, the bar being built is written out, and the book as it is then (at the next boundary's time) */
+    void finish() {
+        boundary_read_ns_ = 0;
+        if (bars_.enabled()) {
+            print_bars_(latest_timestamp_);
+        }
+        if (book_.enabled()) {
+            print_book_(bars_.enabled() ? bars_.bar_start() + bars_.interval_ns()
+                : uint64_t(get_hour_by_timestamp(latest_timestamp_) + 1) * 3600 * 1'000'000'000);
+        }
+    }
+    /* symbol is the raw 8 bytes from the Stock Directory message */
+    bool add_stock_record(uint16_t locate, const char* symbol) {
+        if (!symbols_.add(locate, symbol)) {
             return false;
         }
-        symbol = found_locate->second;
+        if (shared_ != nullptr) {
+            shared_->publish_symbol(locate, symbol);
+        }
         return true;
     }
+
+    bool get_symbol_by_locate(const uint16_t locate, std::string& symbol) {
+        return symbols_.get_symbol(locate, symbol);
+    }
     
     bool get_locate_by_symbol(const std::string& symbol, uint16_t& locate) {
-        auto found_symbol = symbol_to_locate_map.find(symbol);
-        if (found_symbol == symbol_to_locate_map.end()) {
+        return symbols_.get_locate(symbol, locate);
+    }
+
+    bool add_order(const Order& order) {
+        if (!orders_.add(order)) {
             return false;
         }
-        locate = found_symbol->second;
+        if (book_.enabled()) {
+            book_.add(order.stock_locate, order.side, order.price, order.shares);
+        }
         return true;
     }
 
-    bool add_order(const Order& order) {
-        auto [it, emplaced] = order_map.emplace(order.order_reference_number, order);
-        return emplaced;
+    /* Order Executed: the order as it was before, its executed shares come off it with a book */
+    bool execute_order(const uint64_t reference_number, const uint32_t shares, Order& order) {
+        Order* found_order = orders_.find(reference_number);
+        if (found_order == nullptr) {
+            return false;
+        }
+        order = *found_order;
+        if (book_.enabled()) {
+            reduce_(*found_order, shares);
+        }
+        return true;
     }
-    
-    bool add_order(Order&& order) {
-        auto [it, emplaced] = order_map.emplace(order.order_reference_number, std::move(order));
-        return emplaced;
+
+    /* Executed with a price or cancelled: shares come off the order, only kept track of with a book */
+    bool reduce_order(const uint64_t reference_number, const uint32_t shares) {
+        if (!book_.enabled()) {
+            return true;
+        }
+        Order* found_order = orders_.find(reference_number);
+        if (found_order == nullptr) {
+            return false;
+        }
+        reduce_(*found_order, shares);
+        return true;
+    }
+
+    /* Order Delete, only decoded with a book */
+    bool delete_order(const uint64_t reference_number) {
+        Order* found_order = orders_.find(reference_number);
+        if (found_order == nullptr) {
+            return false;
+        }
+        reduce_(*found_order, found_order->shares);
+        return true;
     }
 
     bool get_order_by_reference_number(const uint64_t reference_number, Order& order) {
-        auto found_reference = order_map.find(reference_number);
-        if (found_reference == order_map.end()) {
+        const Order* found_order = orders_.find(reference_number);
+        if (found_order == nullptr) {
             return false;
         }
-        order = found_reference->second;
+        order = *found_order;
         return true;
     }
 
+    /* Replaced order keeps locate and side, and is updated in place */
     bool replace_order(
         const uint64_t original_order_reference_number, 
         const uint64_t new_order_reference_number, 
-        const uint32_t shares, const float price
+        const uint32_t shares, const uint32_t price
     ) {
-        auto found_order = order_map.find(original_order_reference_number);
-        if (found_order == order_map.end()) {
+        if (!book_.enabled()) {
+            return orders_.replace(
+                original_order_reference_number, new_order_reference_number,
+                shares, price);
+        }
+        const Order* found_order = orders_.find(original_order_reference_number);
+        if (found_order == nullptr) {
             return false;
         }
-        const Order& old_order = found_order->second;
-        Order new_order{
-            .stock_locate = old_order.stock_locate,
-            .side = old_order.side,
-            .shares = shares,
-            .price = price,
-            .order_reference_number = new_order_reference_number
-        };
-        order_map.erase(found_order);
-        auto [it, emplaced] = order_map.emplace(new_order_reference_number, std::move(new_order));
-        
-        return emplaced;
+        const Order original = *found_order;
+        if (!orders_.replace(original_order_reference_number, new_order_reference_number, shares, price)) {
+            return false;
+        }
+        if (original.shares != 0) {
+            book_.remove(original.stock_locate, original.side, original.price, original.shares, true);
+        }
+        book_.add(original.stock_locate, original.side, price, shares);
+        return true;
     }
 
     bool add_trade(const Trade& trade) {
-        auto [it, emplaced] = trade_map.emplace(trade.match_number, trade);
-        if (!emplaced) {
+        if (!trades_.add(trade)) {
             return false;
         }
         return handle_trade_(trade);
     }
 
-    bool add_trade(Trade&& trade) {
-        auto [it, emplaced] = trade_map.emplace(trade.match_number, std::move(trade));
-        if (!emplaced) {
+    bool cancel_trade(const uint64_t match_number) {
+        Trade trade;
+        if (!trades_.remove(match_number, trade)) {
             return false;
         }
-        return handle_trade_(it->second);
+        return reverse_trade_(trade);
     }
 
-    bool cancel_trade(const uint16_t match_number) {
-        auto found_trade = trade_map.find(match_number);
-        if (found_trade == trade_map.end()) {
-            return false;
-        }
-        if (!reverse_trade_(found_trade->second)) {
-            return false;
+    void print_memory_usage(std::ostream& os) const {
+        os << "Order store: " << orders_.size() << " orders, "
+        << orders_.memory_usage() / (1024 * 1024) << " MB" << std::endl;
+        os << "Trade ledger: " << trades_.size() << " trades, "
+        << trades_.memory_usage() / (1024 * 1024) << " MB" << std::endl;
+        if (book_.enabled()) {
+            os << "Order book: " << book_.levels() << " price levels, "
+            << book_.memory_usage() / (1024 * 1024) << " MB" << std::endl;
         }
-        trade_map.erase(found_trade);
-        return true;
     }
 
 private:
-    std::unordered_map<uint16_t, std::string> locate_to_symbol_map;
-    std::unordered_map<std::string, uint16_t> symbol_to_locate_map;
-    std::unordered_map<uint16_t, SecurityStats> locate_to_sec_stats_map;
-    std::unordered_map<uint64_t, Order> order_map; // key = order reference number
-    std::unordered_map<uint64_t, Trade> trade_map; // key = match number
+    SymbolDirectory symbols_;
+    // Flat, indexed by stock locate. Only [0, max_traded_locate_] can have seen trades
+    SecurityStatsArray sec_stats_;
+    size_t max_traded_locate_ = 0;
+    OrderStore orders_; // key = order reference number
+    TradeLedger trades_; // key = match number
+    BarEngine bars_;
+    std::vector<BarRow> bar_rows_; // reused at every bar
+    OrderBook book_;
+    std::vector<BookRow> book_rows_; // reused at every boundary
 
     uint64_t latest_timestamp_ = 0;
     bool market_open_ = false;
-    std::string output_dir_;
-    std::ofstream ofs_;
 
-    PrintFormat print_format_;
+    SnapshotWriter& writer_;
+    bool external_boundaries_;
+    bool checkpoints_ = false;
+    size_t shard_ = 0;
+    size_t last_image_size_ = 0;
+    uint64_t boundary_read_ns_ = 0; // of the boundary being crossed, see snapshot_boundary
+    SharedStats* shared_ = nullptr;
 
     bool handle_trade_(const Trade& trade) {
-        // Insert entry if stock does not exist 
-        auto [it, emplaced] = locate_to_sec_stats_map.emplace(trade.stock_locate, trade.stock_locate);
-        return it->second.handle_trade(trade);
+        if (trade.stock_locate > max_traded_locate_) {
+            max_traded_locate_ = trade.stock_locate;
+        }
+        bars_.add_trade(trade);
+        SecurityStats& stats = sec_stats_[trade.stock_locate];
+        stats.handle_trade(trade);
+        if (shared_ != nullptr) {
+            shared_->publish(trade.stock_locate, stats, latest_timestamp_);
+        }
+        return true;
     }
 
     bool reverse_trade_(const Trade& trade) {
-        auto it = locate_to_sec_stats_map.find(trade.stock_locate);
-        if (it == locate_to_sec_stats_map.end()) {
+        SecurityStats& stats = sec_stats_[trade.stock_locate];
+        if (!stats.active()) {
             return false;
         }
-        return it->second.reverse_trade(trade);
-    }
-
-    /*
-        Only one thread has access to SystemData,
-        so no need to lock when printing.
-        I don't think it's necessary to print on a separate thread
-        since it would lock and parser would block anyways
-    */
-    void print_vwaps_(const int hour) {
-        switch(print_format_) {
-            case PrintFormat::csv: {
-                print_vwaps_csv_(hour);
-                break;
-            }
-            case PrintFormat::log: {
-                print_vwaps_log_(hour);
-            }
+        stats.reverse_trade(trade);
+        if (shared_ != nullptr) {
+            shared_->publish(trade.stock_locate, stats, latest_timestamp_);
         }
+        return true;
     }
 
-    void print_vwaps_log_(const int hour) {
-        std::string file_name = std::to_string(hour) + ".log";
-        std::string output_file =  output_dir_ + "/" + file_name;
-        ofs_.open(output_file);
-        if (!ofs_.is_open()) {
-            std::cerr << "Error opening output file " << output_file << std::endl;
+    /* shares come off order, which leaves the book once it has none left (it already has if it had none) */
+    void reduce_(Order& order, uint32_t shares) {
+        if (order.shares == 0) {
             return;
         }
-        
-        ofs_ << std::setw(2) << std::setfill('0') << hour << ":00:00" << std::endl;
-
-        for (const auto& [locate, stats]: locate_to_sec_stats_map) {
-            ofs_ << std::left << std::setw(8) << locate_to_symbol_map.at(locate) << " "
-            << std::fixed << std::setprecision(4) << stats.get_vwap()
-            << std::endl;
-        }
-        ofs_ << "-------------------------------" << std::endl << std::endl;
-        ofs_.close();
+        shares = std::min(shares, order.shares);
+        order.shares -= shares;
+        book_.remove(order.stock_locate, order.side, order.price, shares, order.shares == 0);
     }
 
-    void print_vwaps_csv_(const int hour) {
-        std::string file_name = std::to_string(hour) + ".csv";
-        std::string output_file =  output_dir_ + "/" + file_name;
-        ofs_.open(output_file);
-        if (!ofs_.is_open()) {
-            std::cerr << "Error opening output file " << output_file << std::endl;
-            return;
+    void advance_clock_(const uint64_t timestamp) {
+        if (bars_.crosses_bar(timestamp)) {
+            print_bars_(timestamp);
+            if (book_.enabled()) {
+                print_book_(bars_.bar_start());
+            }
+        }
+        int current_hour = get_hour_by_timestamp(latest_timestamp_);
+        int potential_next_hour = get_hour_by_timestamp(timestamp);
+        if (market_open_ && current_hour < potential_next_hour) {
+            print_vwaps_(potential_next_hour);
         }
-        ofs_ << "hour,symbol,vwap" << std::endl;
-        for (const auto& [locate, stats]: locate_to_sec_stats_map) {
-            ofs_ << hour << "," 
-            << locate_to_symbol_map.at(locate) << "," 
-            << std::fixed << std::setprecision(4) << stats.get_vwap() << std::endl;
+        if (book_.enabled() && !bars_.enabled() && current_hour < potential_next_hour) {
+            print_book_(uint64_t(potential_next_hour) * 3600 * 1'000'000'000);
         }
-        ofs_.close();
+    }
+
+    /* The image is taken here, on the shard's thread, the writer thread writes it out */
+    void checkpoint_(const uint64_t input_offset, const uint64_t timestamp) {
+        StateWriter image;
+        // Images only grow during the day, this one is likely a bit bigger than the last
+        image.reserve(last_image_size_ + last_image_size_ / 8);
+        save(image);
+        last_image_size_ = image.data().size();
+        writer_.submit_checkpoint(shard_, input_offset, timestamp, std::move(image.data()));
+    }
+
+    /* Closes the current bar and starts the one timestamp falls in */
+    void print_bars_(const uint64_t timestamp) {
+        const uint64_t bar_start = bars_.bar_start();
+        bar_rows_.clear();
+        bars_.close_bar(timestamp, symbols_, bar_rows_);
+        writer_.submit_bars(bar_start, bar_rows_, boundary_read_ns_);
+    }
+
+    /* The top of the book of the symbols whose book changed, as it is at the boundary at time */
+    void print_book_(const uint64_t time) {
+        book_rows_.clear();
+        book_.take_depth(symbols_, book_rows_);
+        writer_.submit_book(time, book_rows_, boundary_read_ns_);
+    }
+
+    /*
+        Only one thread has access to SystemData,
+        so no need to lock when taking the snapshot.
+        The boundary only costs a copy of the flat stats array, the writer thread
+            works out the VWAPs from the copy, formats and writes them.
+    */
+    void print_vwaps_(const int hour) {
+        std::unique_ptr<StatsSnapshot> snapshot = writer_.acquire_stats_snapshot();
+        snapshot->freeze(sec_stats_, symbols_, max_traded_locate_ + 1);
+        writer_.submit_stats(hour, std::move(snapshot), boundary_read_ns_);
     }
 };
 
@@ -0,0 +1,166 @@
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "../itch_generator.h"
+
+/*
+    Writes a synthetic ITCH 5.0 day, for load testing without real data files.
+    Deterministic: the same options (seed included) give the same file.
+    See ItchGenerator for what the day looks like.
+*/
+
+static void print_usage(const char* program) {
+    const GeneratorConfig defaults;
+    std::cerr << "Usage: " << program << " <output file, '-' for stdout> [options]" << std::endl
+    << "Options:" << std::endl
+    << "  --seed=<n>               (default: " << defaults.seed << ")" << std::endl
+    << "  --symbols=<n>            number of securities, up to 65535 (default: " << defaults.symbols << ")" << std::endl
+    << "  --orders=<n>             orders added over the day, scales the message rate (default: " << defaults.orders << ")" << std::endl
+    << "  --execute-ratio=<x>      share of orders executed (default: " << defaults.execute_ratio << ")" << std::endl
+    << "  --replace-ratio=<x>      share of orders replaced (default: " << defaults.replace_ratio << ")" << std::endl
+    << "  --cancel-ratio=<x>       share of orders partly cancelled first (default: " << defaults.cancel_ratio << ")" << std::endl
+    << "  --break-ratio=<x>        share of executions broken later (default: " << defaults.break_ratio << ")" << std::endl
+    << "  --trade-ratio=<x>        non-displayed trades per order added (default: " << defaults.trade_ratio << ")" << std::endl
+    << "  --lifetime=<seconds>     mean order lifetime (default: " << defaults.mean_lifetime_s << ")" << std::endl
+    << "  --start=<hh:mm>, --open=<hh:mm>, --close=<hh:mm>, --end=<hh:mm>" << std::endl
+    << "                           timeline of the day (default: 04:00, 09:30, 16:00, 20:00)" << std::endl
+    << "  --extended-share=<x>     share of the orders added outside regular hours (default: " << defaults.extended_share << ")" << std::endl;
+}
+
+static bool parse_count(const std::string& value, uint64_t& result) {
+    try {
+        size_t pos = 0;
+        result = std::stoull(value, &pos);
+        return pos == value.size();
+    } catch (...) {
+        return false;
+    }
+}
+
+static bool parse_ratio(const std::string& value, double& result, const double max = 1.0) {
+    try {
+        size_t pos = 0;
+        result = std::stod(value, &pos);
+        return pos == value.size() && result >= 0 && result <= max;
+    } catch (...) {
+        return false;
+    }
+}
+
+/* hh:mm, in ns since midnight */
+static bool parse_time(const std::string& value, uint64_t& result_ns) {
+    unsigned hours = 0, minutes = 0;
+    char extra = 0;
+    if (std::sscanf(value.c_str(), "%u:%u%c", &hours, &minutes, &extra) != 2 || hours > 24 || minutes > 59) {
+        return false;
+    }
+    result_ns = (uint64_t(hours) * 3600 + minutes * 60) * 1'000'000'000;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    GeneratorConfig config;
+    std::string output_path;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            output_path = arg;
+            continue;
+        }
+        const size_t eq = arg.find('=');
+        const std::string name = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+        const std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        uint64_t count = 0;
+        bool valid = true;
+        if (name == "seed") {
+            valid = parse_count(value, config.seed);
+        } else if (name == "symbols") {
+            valid = parse_count(value, count) && count > 0 && count < kMaxLocates;
+            config.symbols = count;
+        } else if (name == "orders") {
+            valid = parse_count(value, count);
+            config.orders = count;
+        } else if (name == "execute-ratio") {
+            valid = parse_ratio(value, config.execute_ratio);
+        } else if (name == "replace-ratio") {
+            valid = parse_ratio(value, config.replace_ratio, 0.99);
+        } else if (name == "cancel-ratio") {
+            valid = parse_ratio(value, config.cancel_ratio);
+        } else if (name == "break-ratio") {
+            valid = parse_ratio(value, config.break_ratio);
+        } else if (name == "trade-ratio") {
+            valid = parse_ratio(value, config.trade_ratio);
+        } else if (name == "lifetime") {
+            valid = parse_ratio(value, config.mean_lifetime_s, 86400) && config.mean_lifetime_s > 0;
+        } else if (name == "extended-share") {
+            valid = parse_ratio(value, config.extended_share);
+        } else if (name == "start") {
+            valid = parse_time(value, config.start_ns);
+        } else if (name == "open") {
+            valid = parse_time(value, config.open_ns);
+        } else if (name == "close") {
+            valid = parse_time(value, config.close_ns);
+        } else if (name == "end") {
+            valid = parse_time(value, config.end_ns);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            std::cerr << "Invalid option " << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (output_path.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (config.execute_ratio + config.replace_ratio > 1) {
+        std::cerr << "--execute-ratio and --replace-ratio add up to more than 1" << std::endl;
+        return 1;
+    }
+    // Market open and close are system events and the crosses happen at them, they need to be in the timeline
+    if (!(config.start_ns < config.open_ns && config.open_ns < config.close_ns && config.close_ns < config.end_ns)
+        || config.open_ns < 60 * 1'000'000'000ull) {
+        std::cerr << "Times must be in the order --start < --open < --close < --end" << std::endl;
+        return 1;
+    }
+
+    std::ofstream ofs;
+    std::ostream* out = &std::cout;
+    if (output_path != "-") {
+        ofs.open(output_path, std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            std::cerr << "Error opening output file " << output_path << std::endl;
+            return 1;
+        }
+        out = &ofs;
+    }
+
+    ItchGenerator generator(config);
+    const bool written = generator.generate([&](const char* data, const size_t size) {
+        out->write(data, size);
+        return static_cast<bool>(*out);
+    });
+    out->flush();
+    if (!written || !*out) {
+        std::cerr << "Error writing " << output_path << std::endl;
+        return 1;
+    }
+
+    const ItchGenerator::Summary& summary = generator.summary();
+    std::cerr << summary.total_messages << " messages, " << summary.bytes << " bytes" << std::endl;
+    for (size_t type = 0; type < summary.messages.size(); ++type) {
+        if (summary.messages[type] != 0) {
+            std::cerr << "  " << char(type) << ": " << summary.messages[type] << std::endl;
+        }
+    }
+    const uint64_t peak = summary.peak_second / 1'000'000'000;
+    char peak_time[16];
+    std::snprintf(peak_time, sizeof(peak_time), "%02u:%02u:%02u",
+        unsigned(peak / 3600), unsigned(peak / 60 % 60), unsigned(peak % 60));
+    std::cerr << "Busiest second: " << peak_time << ", " << summary.peak_messages << " messages" << std::endl;
+    return 0;
+}
@@ -0,0 +1,441 @@
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../compressed_file.h"
+#include "../mapped_file.h"
+#include "../metrics.h"
+#include "../network_feed.h"
+
+/*
+    Sends an ITCH file over the network, as a MoldUDP64 feed (udp://) or from a SoupBinTCP server (tcp://),
+        to run the parser against a feed on one machine (see network_feed.h for both).
+    --rate paces it, so the message rate the parser sustains, and what gets dropped past it, can be measured.
+    udp: datagrams go to host:port as they are built, sendmmsg sends a batch of them per system call.
+        Start the parser first, whatever is sent before it listens is lost (and shows as a gap).
+    tcp: listens on host:port, and starts once a client has logged in.
+*/
+
+struct ReplayConfig {
+    std::string data_file_path;
+    FeedAddress address;
+    uint64_t rate = 0;          // messages per second, 0 = as fast as possible
+    size_t packet_size = 1400;  // MoldUDP64 datagrams, header included
+    std::string session = "REPLAY";
+    uint64_t drop = 0;          // MoldUDP64: every n-th datagram is not sent, 0 = none
+};
+
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " <data file> <udp://<host>:<port> or tcp://<host>:<port>> [options]" << std::endl
+    << "Options:" << std::endl
+    << "  --rate=<n>           messages per second (default: as fast as possible)" << std::endl
+    << "  --packet-size=<n>    max size of a MoldUDP64 datagram, header included (default: 1400)" << std::endl
+    << "  --session=<name>     session name, up to 10 characters (default: REPLAY)" << std::endl
+    << "  --drop=<n>           don't send every n-th MoldUDP64 datagram, to see gaps (default: none)" << std::endl;
+}
+
+static bool parse_count(const std::string& value, uint64_t& result) {
+    try {
+        size_t pos = 0;
+        result = std::stoull(value, &pos);
+        return pos == value.size();
+    } catch (...) {
+        return false;
+    }
+}
+
+/* Spreads messages evenly over time: how many may go now, given how many went so far */
+class Pacer {
+public:
+    explicit Pacer(const uint64_t rate): rate_{rate}, start_ns_{steady_ns()} {}
+
+    uint64_t allowed(const uint64_t sent) const {
+        if (rate_ == 0) {
+            return std::numeric_limits<uint64_t>::max();
+        }
+        const uint64_t due = static_cast<uint64_t>(double(steady_ns() - start_ns_) * 1e-9 * double(rate_)) + 1;
+        return due > sent ? due - sent : 0;
+    }
+
+    /* Nothing may go yet: wait about as long as the next message is due in */
+    void wait() const {
+        const uint64_t interval_ns = 1'000'000'000 / rate_;
+        if (interval_ns >= 50'000) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(interval_ns / 2));
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    uint64_t rate_;
+    uint64_t start_ns_;
+};
+
+/* What was sent, printed at the end */
+struct ReplaySummary {
+    uint64_t messages = 0;
+    uint64_t packets = 0;
+    uint64_t dropped = 0;
+    uint64_t start_ns = steady_ns();
+};
+
+static void print_summary(const ReplaySummary& summary) {
+    const double seconds = double(steady_ns() - summary.start_ns) / 1e9;
+    std::cerr << summary.messages << " messages in " << summary.packets << " packets";
+    if (summary.dropped != 0) {
+        std::cerr << " (" << summary.dropped << " dropped on purpose)";
+    }
+    std::cerr << ", " << std::fixed << std::setprecision(3) << seconds << " s, "
+    << std::setprecision(2) << double(summary.messages) / seconds / 1e6 << " M messages/s" << std::endl;
+}
+
+/* The next message of the file at pos, as it is in the file (length prefix included) */
+static bool next_message(const char*& pos, const char* end, const char*& message, size_t& size) {
+    if (end - pos < 2 || size_t(end - pos) < 2 + read_big_endian<2>(pos)) {
+        return false;
+    }
+    message = pos;
+    size = 2 + read_big_endian<2>(pos);
+    pos += size;
+    return true;
+}
+
+static bool replay_mold(const ReplayConfig& config, const MappedFile& file) {
+    sockaddr_in addr{};
+    if (!resolve_feed_address(config.address, addr)) {
+        return false;
+    }
+    const int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        std::cerr << "Error creating a UDP socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    const int send_buffer = 4 << 20;
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer));
+
+    char session[kMoldSessionLength];
+    std::memset(session, ' ', sizeof(session));
+    std::memcpy(session, config.session.data(), config.session.size());
+
+    // A batch of datagrams built in place, then sent with one sendmmsg.
+    // Room for the largest datagram each, a message bigger than --packet-size still goes (on its own)
+    constexpr size_t kBatch = 64;
+    std::vector<char> buffers(kBatch * kMoldMaxPacketSize);
+    std::vector<iovec> iovecs(kBatch);
+    std::vector<mmsghdr> headers(kBatch);
+    for (size_t i = 0; i < kBatch; ++i) {
+        iovecs[i].iov_base = buffers.data() + i * kMoldMaxPacketSize;
+        headers[i].msg_hdr.msg_name = &addr;
+        headers[i].msg_hdr.msg_namelen = sizeof(addr);
+        headers[i].msg_hdr.msg_iov = &iovecs[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+    }
+    auto send_batch = [&](const size_t n) {
+        for (size_t sent = 0; sent < n; ) {
+            const int result = ::sendmmsg(fd, headers.data() + sent, n - sent, 0);
+            if (result < 0) {
+                if (errno == EINTR || errno == ENOBUFS || errno == EAGAIN) {
+                    continue;
+                }
+                std::cerr << "Error sending to " << config.address.host << ":" << config.address.port
+                << ": " << std::strerror(errno) << std::endl;
+                return false;
+            }
+            sent += result;
+        }
+        return true;
+    };
+
+    ReplaySummary summary;
+    const Pacer pacer(config.rate);
+    const char* pos = file.data();
+    const char* const end = file.data() + file.size();
+    uint64_t sequence = 1;
+    bool ok = true;
+    bool more = file.size() != 0;
+    while (ok && more) {
+        uint64_t allowed = pacer.allowed(summary.messages);
+        if (allowed == 0) {
+            pacer.wait();
+            continue;
+        }
+        size_t batched = 0;
+        while (batched < kBatch && allowed != 0 && more) {
+            char* const packet = static_cast<char*>(iovecs[batched].iov_base);
+            size_t size = kMoldHeaderSize;
+            uint16_t count = 0;
+            const char* message = nullptr;
+            size_t message_size = 0;
+            const char* next = pos;
+            while (count < allowed && count < kMoldEndOfSession - 1 && next_message(next, end, message, message_size)) {
+                if (size + message_size > config.packet_size && count != 0) {
+                    break;
+                }
+                std::memcpy(packet + size, message, message_size);
+                size += message_size;
+                pos = next;
+                ++count;
+            }
+            if (count == 0) {
+                if (pos != end) {
+                    std::cerr << "Truncated message at end of file " << config.data_file_path << std::endl;
+                }
+                more = false;
+                break;
+            }
+            write_mold_header(packet, session, sequence, count);
+            sequence += count;
+            allowed -= count;
+            summary.messages += count;
+            ++summary.packets;
+            if (config.drop != 0 && summary.packets % config.drop == 0) {
+                ++summary.dropped;
+                continue;
+            }
+            iovecs[batched].iov_len = size;
+            ++batched;
+        }
+        ok = send_batch(batched);
+    }
+
+    // End of Session, a few times over in case one is lost
+    if (ok) {
+        char packet[kMoldHeaderSize];
+        write_mold_header(packet, session, sequence, kMoldEndOfSession);
+        for (int i = 0; i < 3; ++i) {
+            ::sendto(fd, packet, sizeof(packet), 0, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    ::close(fd);
+    print_summary(summary);
+    return ok;
+}
+
+static bool write_all(const int fd, const char* data, size_t size) {
+    while (size != 0) {
+        const ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool read_all(const int fd, char* data, size_t size) {
+    while (size != 0) {
+        const ssize_t n = ::recv(fd, data, size, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+/* Waits for a client to log in, returns its socket (-1 on error) and the sequence number it asked for */
+static int accept_soup_client(const ReplayConfig& config, uint64_t& requested_sequence) {
+    sockaddr_in addr{};
+    if (!resolve_feed_address(config.address, addr)) {
+        return -1;
+    }
+    const int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    const int on = 1;
+    ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (listener < 0 || ::bind(listener, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0
+        || ::listen(listener, 1) != 0) {
+        std::cerr << "Error listening on " << config.address.host << ":" << config.address.port
+        << ": " << std::strerror(errno) << std::endl;
+        if (listener >= 0) {
+            ::close(listener);
+        }
+        return -1;
+    }
+    std::cerr << "Waiting for a client on " << config.address.host << ":" << config.address.port << std::endl;
+
+    while (true) {
+        const int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Error accepting a client: " << std::strerror(errno) << std::endl;
+            ::close(listener);
+            return -1;
+        }
+        char login[2 + kSoupLoginRequestSize];
+        if (!read_all(fd, login, sizeof(login)) || login[2] != kSoupLoginRequest
+            || read_big_endian<2>(login) != kSoupLoginRequestSize) {
+            std::cerr << "Client did not log in, waiting for another one" << std::endl;
+            ::close(fd);
+            continue;
+        }
+        ::close(listener);
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        requested_sequence = std::max<uint64_t>(1, read_soup_number(login + sizeof(login) - kSoupSequenceLength, kSoupSequenceLength));
+        return fd;
+    }
+}
+
+static bool replay_soup(const ReplayConfig& config, const MappedFile& file) {
+    uint64_t sequence = 1;
+    const int fd = accept_soup_client(config, sequence);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Skip to where the client asked to start
+    const char* pos = file.data();
+    const char* const end = file.data() + file.size();
+    const char* message = nullptr;
+    size_t message_size = 0;
+    for (uint64_t skip = sequence - 1; skip != 0 && next_message(pos, end, message, message_size); --skip) {
+    }
+
+    char accepted[2 + kSoupLoginAcceptedSize];
+    write_soup_header(accepted, kSoupLoginAccepted, kSoupLoginAcceptedSize - 1);
+    std::memset(accepted + 3, ' ', kSoupSessionLength);
+    std::memcpy(accepted + 3, config.session.data(), config.session.size());
+    write_soup_number(accepted + 3 + kSoupSessionLength, kSoupSequenceLength, sequence);
+    bool ok = write_all(fd, accepted, sizeof(accepted));
+
+    // Sequenced Data packets are gathered in a buffer, written when it's full or the pacer makes us wait
+    constexpr size_t kBufferSize = size_t(64) << 10;
+    std::vector<char> buffer;
+    buffer.reserve(kBufferSize + 3 + 65536);
+    ReplaySummary summary;
+    const Pacer pacer(config.rate);
+    uint64_t last_sent_ns = steady_ns();
+    auto flush = [&] {
+        ok = ok && write_all(fd, buffer.data(), buffer.size());
+        buffer.clear();
+        last_sent_ns = steady_ns();
+    };
+    bool more = true;
+    while (ok && more) {
+        uint64_t allowed = pacer.allowed(summary.messages);
+        if (allowed == 0) {
+            flush();
+            // Nothing for a second: a heartbeat, so the client knows we're still here
+            if (steady_ns() - last_sent_ns >= kSoupHeartbeatIntervalNs) {
+                char heartbeat[3];
+                write_soup_header(heartbeat, kSoupServerHeartbeat, 0);
+                ok = write_all(fd, heartbeat, sizeof(heartbeat));
+                last_sent_ns = steady_ns();
+            }
+            pacer.wait();
+            continue;
+        }
+        while (allowed != 0 && buffer.size() < kBufferSize) {
+            if (!next_message(pos, end, message, message_size)) {
+                more = false;
+                break;
+            }
+            // Soup packet: the ITCH message without its length prefix, after the Soup length and type
+            const size_t at = buffer.size();
+            buffer.resize(at + 3 + message_size - 2);
+            write_soup_header(buffer.data() + at, kSoupSequencedData, message_size - 2);
+            std::memcpy(buffer.data() + at + 3, message + 2, message_size - 2);
+            --allowed;
+            ++summary.messages;
+            ++summary.packets;
+        }
+        flush();
+    }
+    if (ok && pos != end) {
+        std::cerr << "Truncated message at end of file " << config.data_file_path << std::endl;
+    }
+
+    if (ok) {
+        char end_of_session[3];
+        write_soup_header(end_of_session, kSoupEndOfSession, 0);
+        write_all(fd, end_of_session, sizeof(end_of_session));
+        // Until the client has seen it and gone
+        char ignored[256];
+        while (::recv(fd, ignored, sizeof(ignored), 0) > 0) {
+        }
+    } else {
+        std::cerr << "Client went away after " << summary.messages << " messages" << std::endl;
+    }
+    ::close(fd);
+    print_summary(summary);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    ReplayConfig config;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            positional.push_back(arg);
+            continue;
+        }
+        const size_t eq = arg.find('=');
+        const std::string name = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+        const std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        uint64_t count = 0;
+        bool valid = true;
+        if (name == "rate") {
+            valid = parse_count(value, config.rate);
+        } else if (name == "packet-size") {
+            valid = parse_count(value, count) && count > kMoldHeaderSize && count <= kMoldMaxPacketSize;
+            config.packet_size = count;
+        } else if (name == "session") {
+            config.session = value;
+            valid = !value.empty() && value.size() <= kMoldSessionLength;
+        } else if (name == "drop") {
+            valid = parse_count(value, config.drop);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            std::cerr << "Invalid option " << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (positional.size() != 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    config.data_file_path = positional[0];
+    config.address = parse_feed_address(positional[1]);
+    if (config.address.protocol == FeedProtocol::none) {
+        std::cerr << "Send to udp://<host>:<port> (MoldUDP64) or tcp://<host>:<port> (SoupBinTCP), not " << positional[1] << std::endl;
+        return 1;
+    }
+
+    if (detect_compression(config.data_file_path) != Compression::none) {
+        std::cerr << config.data_file_path << " is compressed, decompress it first" << std::endl;
+        return 1;
+    }
+    MappedFile file;
+    if (!file.open(config.data_file_path)) {
+        std::cerr << "Error mapping file " << config.data_file_path << std::endl;
+        return 1;
+    }
+
+    const bool ok = config.address.protocol == FeedProtocol::mold_udp64 ? replay_mold(config, file) : replay_soup(config, file);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include "../snapshot_file.h"
+
+/*
+    Prints a binary snapshot file (written with the 'binary' format) as csv,
+        or with --index only the list of snapshots in it.
+    Also a small example of reading the file in place with SnapshotFileReader.
+*/
+
+static std::string time_of_day(const uint64_t timestamp) {
+    const uint64_t seconds = timestamp / 1'000'000'000;
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%02u:%02u:%02u",
+        unsigned(seconds / 3600), unsigned(seconds / 60 % 60), unsigned(seconds % 60));
+    return buf;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <snapshots.bin> [--index]" << std::endl;
+        return 1;
+    }
+    const bool index_only = argc > 2 && std::string(argv[2]) == "--index";
+
+    SnapshotFileReader reader;
+    if (!reader.open(argv[1])) {
+        std::cerr << "Error reading " << argv[1] << ": " << reader.error() << std::endl;
+        return 1;
+    }
+
+    if (index_only) {
+        std::cout << "time,rows" << std::endl;
+        for (size_t i = 0; i < reader.size(); ++i) {
+            const SnapshotView snapshot = reader.snapshot(i);
+            std::cout << time_of_day(snapshot.interval_ns) << "," << snapshot.row_count << "\n";
+        }
+        return 0;
+    }
+
+    std::cout << "time,locate,symbol,vwap,volume,notional" << std::endl;
+    for (size_t i = 0; i < reader.size(); ++i) {
+        const SnapshotView snapshot = reader.snapshot(i);
+        const std::string time = time_of_day(snapshot.interval_ns);
+        for (size_t row = 0; row < snapshot.row_count; ++row) {
+            std::cout << time << "," << snapshot.locate[row] << ","
+            << std::string_view(snapshot.symbol(row), kSymbolLength) << ","
+            << price_4digits_to_string(snapshot.vwap[row]) << ","
+            << snapshot.volume[row] << ","
+            << notional_4digits_to_string(snapshot.notional[row]) << "\n";
+        }
+    }
+    return 0;
+}
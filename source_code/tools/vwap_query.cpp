@@ -0,0 +1,133 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "../shared_stats.h"
+
+/*
+    Prints the live VWAP, volume and notional of some (or every traded) symbol
+        from the shared memory a parser run with --shm=<name> publishes in, see shared_stats.h.
+    With --interval it keeps printing them until the parser is done, each read takes well under a microsecond
+        and never holds up the parser.
+*/
+
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " <shm name> [<symbol>...] [options]" << std::endl
+    << "Options:" << std::endl
+    << "  --interval=<ms>    print again every ms until the parser is done (default: once)" << std::endl
+    << "  --unlink           remove the shared memory and exit" << std::endl;
+}
+
+static std::string time_of_day(const uint64_t timestamp) {
+    const uint64_t seconds = timestamp / 1'000'000'000;
+    char buf[24];
+    std::snprintf(buf, sizeof(buf), "%02u:%02u:%02u.%06u", unsigned(seconds / 3600), unsigned(seconds / 60 % 60),
+        unsigned(seconds % 60), unsigned(timestamp / 1000 % 1'000'000));
+    return buf;
+}
+
+static void print_row(const uint16_t locate, const SharedStatsRow& row) {
+    std::cout << std::string_view(row.symbol.data(), kSymbolLength) << "," << locate << ","
+    << price_4digits_to_string(row.vwap()) << "," << row.volume << ","
+    << notional_4digits_to_string(row.notional) << "," << time_of_day(row.updated_ns) << "\n";
+}
+
+int main(int argc, char** argv) {
+    std::string name;
+    std::vector<std::string> symbols;
+    uint64_t interval_ms = 0;
+    bool unlink = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--unlink") {
+            unlink = true;
+        } else if (arg.rfind("--interval=", 0) == 0) {
+            try {
+                interval_ms = std::stoull(arg.substr(11));
+            } catch (...) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg.rfind("--", 0) == 0) {
+            print_usage(argv[0]);
+            return 1;
+        } else if (name.empty()) {
+            name = arg;
+        } else {
+            symbols.push_back(arg);
+        }
+    }
+    if (name.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (unlink) {
+        if (!SharedStats::unlink(name)) {
+            std::cerr << "Could not remove " << shared_stats_name(name) << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    SharedStatsReader reader;
+    if (!reader.open(name)) {
+        std::cerr << "Error reading " << name << ": " << reader.error() << std::endl;
+        return 1;
+    }
+
+    // Symbols are looked up once, their locates don't change during the day
+    std::vector<uint16_t> locates;
+    for (const std::string& symbol: symbols) {
+        uint16_t locate = 0;
+        if (!reader.find(symbol, locate)) {
+            std::cerr << "No symbol " << symbol << " in " << name << " (yet)" << std::endl;
+            continue;
+        }
+        locates.push_back(locate);
+    }
+    if (!symbols.empty() && locates.empty()) {
+        return 1;
+    }
+
+    // A slot stuck in the middle of a write is reported and left out, the exit code is then 1
+    bool all_read = true;
+    auto read = [&](const uint16_t locate, SharedStatsRow& row) {
+        if (reader.read(locate, row)) {
+            return true;
+        }
+        std::cerr << "Locate " << locate << " is still being written, its publisher (pid "
+        << reader.publisher_pid() << ") is gone?" << std::endl;
+        all_read = false;
+        return false;
+    };
+
+    SharedStatsRow row;
+    while (true) {
+        // Read before printing, so the last round is complete if the parser finished meanwhile
+        const bool finished = reader.finished();
+        std::cout << "symbol,locate,vwap,volume,notional,updated" << std::endl;
+        if (locates.empty()) {
+            for (size_t locate = 0; locate < kMaxLocates; ++locate) {
+                if (read(static_cast<uint16_t>(locate), row) && row.has_symbol() && row.updated_ns != 0) {
+                    print_row(static_cast<uint16_t>(locate), row);
+                }
+            }
+        } else {
+            for (const uint16_t locate: locates) {
+                if (read(locate, row)) {
+                    print_row(locate, row);
+                }
+            }
+        }
+        std::cout << std::flush;
+        if (interval_ms == 0 || finished || !all_read) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+    }
+    return all_read ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+#ifndef TRADE_LEDGER_H
+#define TRADE_LEDGER_H
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "state_image.h"
+#include "trade_types.h"
+
+/*
+    Every trade of the day, kept only so a Broken Trade message can take it back out of the stats.
+
+    Match numbers are close to monotonically increasing, so entries sit in fixed-size chunks
+        indexed by (match number - base), where base is the chunk the first trade fell into.
+    Each entry is 12 bytes: locate, shares and the price in 1/10000 ticks.
+    The rare trade that doesn't fit (match number below base or far away, more than 2^32 shares)
+        goes to a small overflow map instead.
+*/
+class TradeLedger {
+public:
+    struct Entry {
+        uint32_t price; // 1/10000 ticks
+        uint32_t shares;
+        uint16_t stock_locate;
+        uint16_t valid; // 0 = no trade with this match number
+    };
+
+    /* Returns false if the match number was already used */
+    bool add(const Trade& trade) {
+        Entry* entry = trade.shares <= std::numeric_limits<uint32_t>::max()
+            ? entry_for_(trade.match_number, true) : nullptr;
+        if (entry == nullptr) {
+            auto [it, emplaced] = overflow_.emplace(trade.match_number, trade);
+            if (emplaced) {
+                ++size_;
+            }
+            return emplaced;
+        }
+        if (entry->valid) {
+            return false;
+        }
+        *entry = Entry{
+            trade.price, static_cast<uint32_t>(trade.shares), trade.stock_locate, 1
+        };
+        ++size_;
+        return true;
+    }
+
+    /* Takes the trade out of the ledger. Returns false if there is no such trade */
+    bool remove(const uint64_t match_number, Trade& trade) {
+        Entry* entry = entry_for_(match_number, false);
+        if (entry != nullptr && entry->valid) {
+            trade = Trade{
+                .stock_locate = entry->stock_locate,
+                .shares = entry->shares,
+                .price = entry->price,
+                .match_number = match_number
+            };
+            entry->valid = 0;
+            --size_;
+            return true;
+        }
+        auto found = overflow_.find(match_number);
+        if (found == overflow_.end()) {
+            return false;
+        }
+        trade = found->second;
+        overflow_.erase(found);
+        --size_;
+        return true;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    size_t memory_usage() const {
+        size_t allocated_chunks = 0;
+        for (const auto& chunk: chunks_) {
+            allocated_chunks += (chunk != nullptr);
+        }
+        return allocated_chunks * kChunkSize * sizeof(Entry)
+            + chunks_.capacity() * sizeof(std::unique_ptr<Entry[]>)
+            // roughly a node plus a bucket per entry
+            + overflow_.size() * (sizeof(Trade) + sizeof(uint64_t) + 2 * sizeof(void*));
+    }
+
+    /*
+        Valid entries only, as (index in chunk, entry) pairs per chunk: with several shards each ledger
+            only has every N-th match number, most of a chunk is empty.
+    */
+    void save(StateWriter& out) const {
+        out.put(has_base_);
+        out.put(base_);
+        out.put(chunks_.size());
+        for (const auto& chunk: chunks_) {
+            uint32_t valid = 0;
+            if (chunk != nullptr) {
+                for (size_t i = 0; i < kChunkSize; ++i) {
+                    valid += chunk[i].valid != 0;
+                }
+            }
+            out.put(valid);
+            char* image = out.extend(valid * (sizeof(uint16_t) + sizeof(Entry)));
+            for (size_t i = 0; valid != 0 && i < kChunkSize; ++i) {
+                if (chunk[i].valid) {
+                    const uint16_t index = static_cast<uint16_t>(i);
+                    std::memcpy(image, &index, sizeof(index));
+                    std::memcpy(image + sizeof(index), &chunk[i], sizeof(Entry));
+                    image += sizeof(index) + sizeof(Entry);
+                }
+            }
+        }
+        out.put(overflow_.size());
+        for (const auto& [match_number, trade]: overflow_) {
+            out.put(trade);
+        }
+        out.put(size_);
+    }
+
+    /* Into an empty ledger */
+    bool load(StateReader& in) {
+        size_t num_chunks = 0;
+        if (size_ != 0 || !in.get(has_base_) || !in.get(base_) || !in.get(num_chunks) || num_chunks > kMaxChunks) {
+            return false;
+        }
+        chunks_.resize(num_chunks);
+        for (auto& chunk: chunks_) {
+            uint32_t valid = 0;
+            if (!in.get(valid) || valid > kChunkSize) {
+                return false;
+            }
+            if (valid != 0) {
+                chunk.reset(new Entry[kChunkSize]());
+            }
+            for (uint32_t k = 0; k < valid; ++k) {
+                uint16_t i = 0;
+                if (!in.get(i) || !in.get(chunk[i])) {
+                    return false;
+                }
+            }
+        }
+        size_t overflow_size = 0;
+        if (!in.get(overflow_size)) {
+            return false;
+        }
+        Trade trade;
+        for (size_t k = 0; k < overflow_size; ++k) {
+            if (!in.get(trade)) {
+                return false;
+            }
+            overflow_.emplace(trade.match_number, trade);
+        }
+        return in.get(size_);
+    }
+
+private:
+    static constexpr size_t kChunkBits = 16;
+    static constexpr size_t kChunkSize = size_t(1) << kChunkBits; // entries per chunk
+    // Beyond this many chunks past base, a match number is treated as an outlier
+    static constexpr size_t kMaxChunks = size_t(1) << 20;
+
+    bool has_base_ = false;
+    uint64_t base_ = 0;
+    std::vector<std::unique_ptr<Entry[]>> chunks_;
+    std::unordered_map<uint64_t, Trade> overflow_;
+    size_t size_ = 0;
+
+    Entry* entry_for_(const uint64_t match_number, const bool create) {
+        if (!has_base_) {
+            if (!create) {
+                return nullptr;
+            }
+            base_ = match_number & ~uint64_t(kChunkSize - 1);
+            has_base_ = true;
+        }
+        if (match_number < base_) {
+            return nullptr;
+        }
+        const uint64_t offset = match_number - base_;
+        const size_t chunk_index = offset >> kChunkBits;
+        if (chunk_index >= kMaxChunks) {
+            return nullptr;
+        }
+        if (chunk_index >= chunks_.size()) {
+            if (!create) {
+                return nullptr;
+            }
+            chunks_.resize(chunk_index + 1);
+        }
+        std::unique_ptr<Entry[]>& chunk = chunks_[chunk_index];
+        if (chunk == nullptr) {
+            if (!create) {
+                return nullptr;
+            }
+            chunk.reset(new Entry[kChunkSize]());
+        }
+        return &chunk[offset & (kChunkSize - 1)];
+    }
+};
+
+#endif // TRADE_LEDGER_H
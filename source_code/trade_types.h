@@ -1,9 +1,59 @@
 #ifndef TRADE_TYPES_H
 #define TRADE_TYPES_H
+#include <charconv>
 #include <cstdint>
-#include <unordered_map>
+#include <string>
 
-enum BuySellSide {
+/*
+    Prices are carried as they come in the feed: 4 bytes unsigned int, last 4 digits are after decimal,
+        i.e. in 1/10000 ticks. Nothing is converted to floating point until it's printed.
+*/
+static constexpr uint32_t PRICE_DIVIDER_4DIGITS = 10000;
+
+/* Sum of price * shares, in ticks. 128 bits so a whole day of a busy name can't overflow */
+using Notional = unsigned __int128;
+
+/* 1234500 -> "123.4500", written at out (needs up to 25 chars), returns the end */
+static inline char* format_price_4digits(char* out, const uint64_t price) {
+    out = std::to_chars(out, out + 20, price / PRICE_DIVIDER_4DIGITS).ptr;
+    *out = '.';
+    uint64_t fraction = price % PRICE_DIVIDER_4DIGITS;
+    for (int i = 4; i > 0; --i, fraction /= 10) {
+        out[i] = static_cast<char>('0' + fraction % 10);
+    }
+    return out + 5;
+}
+
+static inline std::string price_4digits_to_string(const uint64_t price) {
+    char buf[25];
+    return std::string(buf, format_price_4digits(buf, price));
+}
+
+/* Notional is in 1/10000 ticks too, and 128 bits */
+static inline std::string notional_4digits_to_string(Notional value) {
+    uint64_t fraction = static_cast<uint64_t>(value % PRICE_DIVIDER_4DIGITS);
+    value /= PRICE_DIVIDER_4DIGITS;
+    std::string digits;
+    do {
+        digits.insert(digits.begin(), char('0' + static_cast<int>(value % 10)));
+        value /= 10;
+    } while (value > 0);
+    char decimals[5] = {'.'};
+    for (int i = 4; i > 0; --i, fraction /= 10) {
+        decimals[i] = static_cast<char>('0' + fraction % 10);
+    }
+    return digits.append(decimals, 5);
+}
+
+/* notional / shares in 1/10000 ticks, rounded half up, 0 without shares */
+static inline uint64_t vwap_4digits(const Notional notional, const uint64_t shares) {
+    if (shares == 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>((2 * notional + shares) / (Notional(2) * shares));
+}
+
+enum BuySellSide: int8_t {
     kUnknown = -1,
     kBuy = 0,
     kSell = 1
@@ -12,15 +62,15 @@ enum BuySellSide {
 struct Order {
     uint16_t stock_locate;
     BuySellSide side;
-    uint64_t shares;
-    float price;
+    uint32_t shares;
+    uint32_t price; // 1/10000 ticks
     uint64_t order_reference_number;
 };
 
 struct Trade {
     uint16_t stock_locate;
-    uint64_t shares;
-    float price;
+    uint64_t shares; // 8 bytes in Cross Trade messages
+    uint32_t price; // 1/10000 ticks
     uint64_t match_number;
     // Don't care about side for the purpose of VWAP
 };
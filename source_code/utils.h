@@ -2,6 +2,11 @@
 #define UTILS_H
 #include <cstdint>
 #include <chrono>
+#include <iomanip>
+#include <istream>
+#include <new>
+#include <sstream>
+#include <string>
 #include <stddef.h>
 
 template <size_t size>
@@ -15,6 +20,51 @@ uint64_t read_big_endian(std::istream& is) {
     return result;
 }
 
+/* Same as above but decodes straight out of a buffer (e.g. a mmapped file) */
+template <size_t size>
+uint64_t read_big_endian(const char* buf) {
+    uint64_t result = 0;
+    for (size_t i = 0; i < size; ++i) {
+        result = (result << 8) + static_cast<uint8_t>(buf[i]);
+    }
+    return result;
+}
+
+/* The other way around, for building packets and files */
+template <size_t size>
+void write_big_endian(char* buf, uint64_t value) {
+    for (size_t i = size; i-- > 0; ) {
+        buf[i] = static_cast<char>(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+/* For flat tables that are walked a lot: start them on a cache line */
+template <typename T, size_t Alignment = 64>
+struct CacheAlignedAllocator {
+    using value_type = T;
+    template <typename U>
+    struct rebind {
+        using other = CacheAlignedAllocator<U, Alignment>;
+    };
+
+    CacheAlignedAllocator() = default;
+    template <typename U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(const size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{Alignment}));
+    }
+    void deallocate(T* p, const size_t) {
+        ::operator delete(p, std::align_val_t{Alignment});
+    }
+
+    template <typename U>
+    bool operator==(const CacheAlignedAllocator<U, Alignment>&) const { return true; }
+    template <typename U>
+    bool operator!=(const CacheAlignedAllocator<U, Alignment>&) const { return false; }
+};
+
 inline int get_hour_by_timestamp(uint64_t timestamp) {
     return (timestamp / 1'000'000'000) / 3600;
 }
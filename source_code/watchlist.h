@@ -0,0 +1,68 @@
+#ifndef WATCHLIST_H
+#define WATCHLIST_H
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "symbol_directory.h"
+
+/*
+    The symbols we want VWAPs for, empty = everything.
+    Symbols are only known by name up front, the feed refers to them by stock locate,
+        so locates are resolved as the Stock Directory messages go by (resolve),
+        and every other message is then checked with a single bit test on its locate (watches).
+*/
+class Watchlist {
+public:
+    Watchlist(): watched_locates_(kMaxLocates / 64) {}
+
+    explicit Watchlist(const std::vector<std::string>& symbols): Watchlist() {
+        for (const std::string& symbol: symbols) {
+            add(symbol);
+        }
+    }
+
+    /* symbol without the trailing space padding, returns false if it can't be a symbol */
+    bool add(const std::string& symbol) {
+        if (symbol.empty() || symbol.size() > kSymbolLength) {
+            return false;
+        }
+        char padded[kSymbolLength];
+        std::memset(padded, ' ', kSymbolLength);
+        std::memcpy(padded, symbol.data(), symbol.size());
+        const uint64_t key = SymbolDirectory::pack_symbol(padded);
+        auto found = std::lower_bound(symbols_.begin(), symbols_.end(), key);
+        if (found == symbols_.end() || *found != key) {
+            symbols_.insert(found, key);
+        }
+        return true;
+    }
+
+    bool empty() const {
+        return symbols_.empty();
+    }
+
+    size_t size() const {
+        return symbols_.size();
+    }
+
+    /* Stock Directory message: starts watching locate if symbol (raw 8 bytes) is on the list */
+    bool resolve(const uint16_t locate, const char* symbol) {
+        if (!std::binary_search(symbols_.begin(), symbols_.end(), SymbolDirectory::pack_symbol(symbol))) {
+            return false;
+        }
+        watched_locates_[locate / 64] |= uint64_t(1) << (locate % 64);
+        return true;
+    }
+
+    bool watches(const uint16_t locate) const {
+        return (watched_locates_[locate / 64] >> (locate % 64)) & 1;
+    }
+
+private:
+    std::vector<uint64_t> symbols_; // packed, sorted
+    std::vector<uint64_t> watched_locates_; // bit per locate
+};
+
+#endif // WATCHLIST_H